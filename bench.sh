@@ -0,0 +1,196 @@
+#!/bin/sh
+# Pi computation using Chudnovsky's algortithm.
+#
+# Benchmark sweep of raspberry-pi2 over digits, threads and engines.
+# Every combination runs REPS times; the median cpu and wall time of
+# every phase the program prints (sieve, bs, bs1, bs2, div/sqrt, mul,
+# out, total) and the median peak RSS go into a CSV, one row per phase.
+# speedup is the one-thread median wall time of the same engine, digits
+# and phase over this one, efficiency is speedup/threads; both are left
+# empty when 1 is not in THREADS.  The lines starting with # record the
+# host, compiler, GMP and split values, so a CSV taken before a GMP or
+# compiler upgrade is a baseline for the one taken after.
+#
+#   ./bench.sh                          or  make bench
+#   DIGITS="100000 1000000 10000000 100000000 1000000000" ./bench.sh
+#   ENGINES="nested steal" THREADS="1 2 4" REPS=5 CSV=new.csv ./bench.sh
+#   MPIRUN="mpirun -n" ENGINES=mpi ./bench.sh
+#
+# Environment (defaults in brackets):
+#   PROG     the binary [./raspberry-pi2]
+#   DIGITS   digit counts [100000 1000000 10000000]
+#   THREADS  thread counts [1, then powers of 2 up to the cores, and the cores]
+#   ENGINES  engines [every one built in, mpi only with MPIRUN]
+#   REPS     runs per combination [3]
+#   OPTION   the <option> argument, 1 also times the output [0]
+#   ARGS     more options for every run, e.g. --lowmem or --split=0.5 []
+#   MPIRUN   launcher of the mpi engine, given the rank count; the mpi
+#            engine runs THREADS ranks of one thread each []
+#   CSV      the result [bench.csv]
+#   CC       compiler to report [cc]
+#
+# Redistribution and use in source and binary forms,with or without
+# modification,are permitted provided that the following conditions are met:
+# 1. Redistributions of source code must retain the above copyright notice,
+# this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+# IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+# EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+# SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+# OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+PROG=${PROG:-./raspberry-pi2}
+DIGITS=${DIGITS:-"100000 1000000 10000000"}
+REPS=${REPS:-3}
+OPTION=${OPTION:-0}
+CSV=${CSV:-bench.csv}
+CC=${CC:-cc}
+
+if [ ! -x "$PROG" ]; then
+  echo "$0: no $PROG, run make first" >&2
+  exit 1
+fi
+
+CORES=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+if [ -z "$THREADS" ]; then
+  THREADS=1
+  t=2
+  while [ $t -lt $CORES ]; do
+    THREADS="$THREADS $t"
+    t=$((t*2))
+  done
+  [ $CORES -gt 1 ] && THREADS="$THREADS $CORES"
+fi
+
+# the engines the binary lists in its usage text
+BUILT=$($PROG 2>&1 | sed -n 's/.*--engine=<name> parallel engine, one of: //p' |
+        sed 's/(default)//')
+if [ -z "$ENGINES" ]; then
+  ENGINES=$(echo $BUILT | sed 's/mpi//')
+  [ -n "$MPIRUN" ] && case " $BUILT " in *" mpi "*) ENGINES="$ENGINES mpi";; esac
+fi
+for e in $ENGINES; do
+  case " $BUILT " in
+    *" $e "*) ;;
+    *) echo "$0: engine $e is not built into $PROG" >&2; exit 1;;
+  esac
+  if [ $e = mpi ] && [ -z "$MPIRUN" ]; then
+    echo "$0: the mpi engine needs MPIRUN, e.g. MPIRUN=\"mpirun -n\"" >&2
+    exit 1
+  fi
+done
+
+RAW=$(mktemp) || exit 1
+ERR=$(mktemp) || exit 1
+trap 'rm -f "$RAW" "$ERR"' EXIT INT TERM
+
+# one run: engine digits threads; its phases go to $RAW
+run() {
+  if [ $1 = mpi ]; then
+    $MPIRUN $3 $PROG $ARGS --engine=mpi $2 $OPTION 1 >/dev/null 2>"$ERR"
+  else
+    $PROG $ARGS --engine=$1 $2 $OPTION $3 >/dev/null 2>"$ERR"
+  fi || {
+    echo "$0: $PROG --engine=$1 $2 $OPTION $3 failed:" >&2
+    cat "$ERR" >&2
+    exit 1
+  }
+  awk -v e=$1 -v d=$2 -v t=$3 '
+    $2=="cputime" { print e, d, t, $1, $4, $7 }
+    /peak RSS=/   { sub(/.*peak RSS=/,""); print e, d, t, "rss", 0, $1 }
+  ' "$ERR" >>"$RAW"
+}
+
+# a first run, which calibrates the split values on a new host
+run $(echo $ENGINES | cut -d' ' -f1) 100000 1
+: >"$RAW"
+SPLIT=$(sed -n 's/^# split=\([^ ]*\) cutoff=\(.*\)/split=\1 cutoff=\2/p' "$ERR")
+
+GMP=$(printf '#include <gmp.h>\nGMP __GNU_MP_VERSION.__GNU_MP_VERSION_MINOR.__GNU_MP_VERSION_PATCHLEVEL\n' |
+      $CC -x c -P -E - 2>/dev/null | sed -n 's/^GMP //p' | tr -d ' ')
+
+{
+  echo "# host=$(uname -n) $(uname -m) cores=$CORES"
+  echo "# cc=$($CC --version 2>/dev/null | head -1)"
+  echo "# gmp=${GMP:-unknown} $SPLIT"
+  echo "# $PROG $ARGS option=$OPTION reps=$REPS $(date -u +%Y-%m-%dT%H:%M:%SZ)"
+  echo "engine,digits,threads,phase,runs,cputime,wallclock,speedup,efficiency,rss_kb"
+} >"$CSV"
+
+for d in $DIGITS; do
+  for e in $ENGINES; do
+    for t in $THREADS; do
+      r=0
+      while [ $r -lt $REPS ]; do
+        run $e $d $t
+        r=$((r+1))
+      done
+      printf '%-8s %11s digits %3s threads done\n' $e $d $t >&2
+    done
+  done
+done
+
+# medians of every phase, in the order the program prints them
+awk '
+  function median(list,   v,n,i,j,x) {
+    n = split(list,v," ")
+    for (i=2; i<=n; i++)
+      for (j=i; j>1 && v[j-1]+0 > v[j]+0; j--) {
+        x = v[j]; v[j] = v[j-1]; v[j-1] = x
+      }
+    return n%2 ? v[(n+1)/2] : (v[n/2]+v[n/2+1])/2
+  }
+  {
+    k = $1 SUBSEP $2 SUBSEP $3
+    if (!(k in seen)) { seen[k] = 1; keys[++nkeys] = k }
+    if ($4=="rss") { rss[k] = rss[k] " " $6; next }
+    p = k SUBSEP $4
+    if (!(p in cpu)) { phases[k] = phases[k] " " $4; runs[p] = 0 }
+    cpu[p] = cpu[p] " " $5
+    wall[p] = wall[p] " " $6
+    runs[p]++
+  }
+  END {
+    for (p in wall)
+      w[p] = median(wall[p])
+    for (i=1; i<=nkeys; i++) {
+      k = keys[i]
+      split(k,f,SUBSEP)
+      m = rss[k] != "" ? median(rss[k]) : ""
+      n = split(phases[k],ph," ")
+      for (j=1; j<=n; j++) {
+        p = k SUBSEP ph[j]
+        c = median(cpu[p])
+        one = f[1] SUBSEP f[2] SUBSEP 1 SUBSEP ph[j]
+        s = e = ""
+        if (one in w && w[one] > 0 && w[p] > 0) {
+          s = sprintf("%.2f",w[one]/w[p])
+          e = sprintf("%.2f",w[one]/w[p]/f[3])
+        }
+        printf "%s,%s,%s,%s,%d,%.2f,%.2f,%s,%s,%s\n",
+          f[1],f[2],f[3],ph[j],runs[p],c,w[p],s,e,m
+      }
+    }
+  }
+' "$RAW" >>"$CSV"
+
+# the total lines, as a table
+awk -F, '
+  /^#/ || $1=="engine" { next }
+  $4=="total" {
+    if (!hdr++)
+      printf "%-8s %11s %7s %9s %7s %6s %10s\n","engine","digits","threads",
+        "wallclock","speedup","eff","rss_kb"
+    printf "%-8s %11s %7s %9s %7s %6s %10s\n",$1,$2,$3,$7,$8,$9,$10
+  }
+' "$CSV"
+echo "results in $CSV"
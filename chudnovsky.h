@@ -0,0 +1,123 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * libchudnovsky: the engines of raspberry-pi2 as a library.  A chud_ctx
+   holds what the command line options would: the engine, its threads,
+   the memory budget and the split values.  It is filled in by
+   chud_init() and may be changed between calls and used again.
+
+     chud_ctx ctx;
+     mpf_t pi;
+
+     chud_init(&ctx);
+     ctx.threads = 4;
+     mpf_init(pi);
+     chud_compute_pi(&ctx,1000000,pi);
+
+   chud_compute_pi() and chud_compute() give the value as an mpf_t with
+   enough precision for the digits asked for; chud_digits() hands the
+   decimal digits to a callback in order, a piece at a time, while the
+   rest is still being converted.  chud_batch() runs a list of them on
+   one engine and hands the digits of each on as it finishes.
+
+ * The library is not reentrant.  The binary splitting keeps its state
+   (the terms, the series, the split values, the engine and its pool)
+   in globals, and a chud_ctx only carries the parameters of a call, so
+   there is one computation per process at a time: every chud_* call
+   takes one process-wide lock and calls from other threads wait for
+   it.  A service with concurrent requests gets them one after the
+   other; run a process per computation to have them side by side.
+   The callback of chud_digits() may run on any of the workers, one
+   piece after the other.  I/O errors of spilling still end the
+   process, as they do in raspberry-pi2; those of the extend root are
+   returned as -1.  Link with -lchudnovsky -lgmp -lm -pthread and the
+   OpenMP flag the library was built with.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CHUDNOVSKY_H
+#define CHUDNOVSKY_H
+
+#include <stddef.h>
+#include <gmp.h>
+
+#define CHUD_BLOCK  (1L<<20)    /* most digits of one chud_digits() piece */
+
+typedef struct {
+  long threads;                 /* workers, default 1 */
+  const char *engine;           /* nested, task, forloop, steal, cilk or
+                                   cilk-task; NULL for the default */
+  long memory;                  /* MB of results waiting for a merge kept
+                                   in memory, the rest spilled; -1 no limit */
+  const char *spill_dir;        /* where spilled results go, NULL for . */
+  int compress;                 /* keep results waiting for a merge packed */
+  int lowmem;                   /* free merge operands once they are used */
+  double split;                 /* where a node splits, 0 for the default */
+  long cutoff;                  /* nodes not split across threads, 0 default */
+  const char *tune_file;        /* the calibrations of raspberry-pi2 to use,
+                                   NULL for the built-in split values */
+  const char *extend;           /* a root saved by --extend to start from
+                                   and update, NULL for none; one that
+                                   cannot be read or written makes the
+                                   call return -1 */
+  long digits;                  /* digits of the last result */
+  long terms;                   /* series terms of the last result */
+} chud_ctx;
+
+/* gets a piece of n digits; nonzero stops the digits */
+typedef int (*chud_digits_fn)(const char *buf,size_t n,void *arg);
+
+void chud_init(chud_ctx *ctx);
+
+/* out = pi good to digits decimal digits; 0 if done, -1 if ctx is bad */
+int  chud_compute_pi(chud_ctx *ctx,long digits,mpf_t out);
+
+/* the same for one of pi, e, ln2, zeta3 or catalan */
+int  chud_compute(chud_ctx *ctx,const char *constant,long digits,mpf_t out);
+
+/*
+  the first digits of the constant (NULL for pi) as text, "3.14159...",
+  the point and the rounded last digit included, given to fn in order
+  in pieces of up to CHUD_BLOCK; 0 when all went, -1 if ctx is bad, or
+  what fn returned to stop them
+*/
+int  chud_digits(chud_ctx *ctx,const char *constant,long digits,
+                 chud_digits_fn fn,void *arg);
+
+/* one computation of chud_batch(), the constant NULL for pi */
+typedef struct {
+  const char *constant;
+  long digits;
+} chud_job;
+
+/* gets a piece of the digits of jobs[job]; n = 0 once they are all in */
+typedef int (*chud_batch_fn)(int job,const char *buf,size_t n,void *arg);
+
+/*
+  all n jobs on the engine of ctx, set up once, one after the other,
+  the shortest first, the digits of each given to fn as chud_digits()
+  gives them as soon as the job is done; jobs of the same constant
+  share one growing root.  0 when all are done, -1 if ctx or a job is
+  bad, or what fn returned to stop them
+*/
+int  chud_batch(chud_ctx *ctx,const chud_job *jobs,int n,
+                chud_batch_fn fn,void *arg);
+
+#endif
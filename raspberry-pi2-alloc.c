@@ -0,0 +1,221 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Memory functions for GMP, installed with --alloc=pool.  Limb arrays of
+   up to POOL_SMALL bytes come from per-thread free lists, one list per
+   power of two size class, carved out of POOL_CHUNK sized arenas, so the
+   many small mpz_init/mpz_clear near the leaves never touch the shared
+   malloc.  Blocks of POOL_LARGE bytes or more, the operands near the
+   root, are mapped on their own, on huge pages when the system has them
+   reserved, and go back to the kernel when freed.  Everything in between
+   is left to malloc.  With --numa a large block is bound to the node of
+   the thread that maps it before anything touches it.
+
+   GMP passes the size of a block to free and realloc, so no header is
+   kept.  A small block freed on another thread joins that thread's list.
+
+   bytes in use counts the arenas and the large blocks, not the small
+   blocks in them, to keep the counters away from the small path.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define POOL_MIN_BITS 4                 /* smallest class, 16 bytes */
+#define POOL_CLASSES  13                /* up to POOL_SMALL */
+#define POOL_SMALL    (1L<<(POOL_MIN_BITS+POOL_CLASSES-1))
+#define POOL_CHUNK    (1L<<20)          /* arena carved into small blocks */
+#define POOL_LARGE    (1L<<20)          /* mapped on its own from here up */
+#define HUGE_PAGE     (1L<<21)
+
+typedef struct block {
+  struct block *next;
+} block_t;
+
+static __thread block_t *freelist[POOL_CLASSES];
+static __thread char    *arena;
+static __thread size_t   arena_left;
+
+static long in_use,high_water;
+
+static void
+count(long n)
+{
+  long now = __atomic_add_fetch(&in_use,n,__ATOMIC_RELAXED);
+  long top = __atomic_load_n(&high_water,__ATOMIC_RELAXED);
+
+  while (now > top &&
+         !__atomic_compare_exchange_n(&high_water,&top,now,1,
+                                      __ATOMIC_RELAXED,__ATOMIC_RELAXED))
+    ;
+}
+
+static void
+out_of_memory(size_t n)
+{
+  fprintf(stderr,"%s: out of memory allocating %lu bytes\n",
+    prog_name,(unsigned long)n);
+  exit(1);
+}
+
+static int
+size_class(size_t n)
+{
+  int c = 0;
+
+  while ((size_t)1<<(c+POOL_MIN_BITS) < n)
+    c++;
+  return c;
+}
+
+/* the length a large block is mapped with */
+static size_t
+large_size(size_t n)
+{
+  size_t pg = n >= HUGE_PAGE ? HUGE_PAGE : 4096;
+
+  return (n+pg-1) & ~(pg-1);
+}
+
+static void *
+mem_alloc(size_t n)
+{
+  block_t *b;
+  size_t len;
+  int c;
+
+  if (n > POOL_SMALL) {
+    if (n < POOL_LARGE) {
+      b = malloc(n);
+    } else {
+      len = large_size(n);
+      b = MAP_FAILED;
+#ifdef MAP_HUGETLB
+      if (len >= HUGE_PAGE)
+        b = mmap(NULL,len,PROT_READ|PROT_WRITE,
+                 MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+#endif
+      if (b==MAP_FAILED) {
+        b = mmap(NULL,len,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+#ifdef MADV_HUGEPAGE
+        if (b!=MAP_FAILED && len >= HUGE_PAGE)
+          madvise(b,len,MADV_HUGEPAGE);
+#endif
+      }
+      if (b==MAP_FAILED)
+        b = NULL;
+      else {
+        numa_place(b,len);
+        count(len);
+      }
+    }
+    if (!b)
+      out_of_memory(n);
+    return b;
+  }
+
+  c = size_class(n);
+  if ((b = freelist[c])) {
+    freelist[c] = b->next;
+    return b;
+  }
+  n = (size_t)1<<(c+POOL_MIN_BITS);
+  if (arena_left < n) {
+    /* the tail of the old arena is lost to the small classes, < 64 kB */
+    arena = malloc(POOL_CHUNK);
+    if (!arena)
+      out_of_memory(POOL_CHUNK);
+    arena_left = POOL_CHUNK;
+    count(POOL_CHUNK);
+  }
+  b = (block_t *)arena;
+  arena += n;
+  arena_left -= n;
+  return b;
+}
+
+static void
+mem_free(void *p,size_t n)
+{
+  block_t *b = p;
+  int c;
+
+  if (n==0)
+    return;
+  if (n > POOL_SMALL) {
+    if (n < POOL_LARGE) {
+      free(p);
+    } else {
+      munmap(p,large_size(n));
+      count(-(long)large_size(n));
+    }
+    return;
+  }
+  c = size_class(n);
+  b->next = freelist[c];
+  freelist[c] = b;
+}
+
+static void *
+mem_realloc(void *p,size_t old,size_t n)
+{
+  void *r;
+
+  if (old==0)
+    return mem_alloc(n);
+  if (old <= POOL_SMALL && n <= POOL_SMALL && size_class(old)==size_class(n))
+    return p;
+  if (old > POOL_SMALL && old < POOL_LARGE && n > POOL_SMALL && n < POOL_LARGE) {
+    if (!(r = realloc(p,n)))
+      out_of_memory(n);
+    return r;
+  }
+  if (old >= POOL_LARGE && n >= POOL_LARGE && large_size(old)==large_size(n))
+    return p;
+  r = mem_alloc(n);
+  memcpy(r,p,old < n ? old : n);
+  mem_free(p,old);
+  return r;
+}
+
+/* route all of GMP's memory through the pools, before any mpz exists */
+void
+alloc_start(void)
+{
+  mp_set_memory_functions(mem_alloc,mem_realloc,mem_free);
+}
+
+/* bytes held by the arenas and large blocks now, and at most so far */
+long
+alloc_in_use(void)
+{
+  return __atomic_load_n(&in_use,__ATOMIC_RELAXED);
+}
+
+long
+alloc_high_water(void)
+{
+  return __atomic_load_n(&high_water,__ATOMIC_RELAXED);
+}
@@ -0,0 +1,234 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Sequential batch on one runtime: many computations in one process,
+   on one engine set up once, from --batch=<file> or chud_batch().  The
+   binary splitting keeps its state in globals, so this is no scheduler
+   of concurrent jobs: they run one after the other, each on the whole
+   pool, and a big job holds up every job after it.  The shortest go
+   first, which keeps the mean wait low, and each result is handed on
+   as soon as its job is done.
+
+   A job for a constant that a later job of the batch, no smaller, wants
+   too keeps its root, g included, in memory.  The next one of that constant
+   only has the engine do the terms past it and merges the two, as
+   --extend does through a file, so a batch of one constant costs about
+   what its biggest job costs alone.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define BATCH_SERIES  8         /* most constants with a root held */
+
+typedef struct {
+  long digits;
+  int i;
+} order_t;
+
+static int
+by_digits(const void *a,const void *b)
+{
+  const order_t *x = a,*y = b;
+
+  if (x->digits!=y->digits)
+    return x->digits < y->digits ? -1 : 1;
+  return x->i-y->i;
+}
+
+static int
+series_index(const series_t *s)
+{
+  int i;
+
+  for (i=0; series_list[i] && series_list[i]!=s; i++)
+    ;
+  return i;
+}
+
+static void
+bs_copy(bs_t r,bs_t s)
+{
+  mpz_set(r->p,s->p);
+  mpz_set(r->q,s->q);
+  mpz_set(r->g,s->g);
+  r->a = s->a;
+  r->b = s->b;
+}
+
+/*
+  r = the root of [0,terms) from held, the root of [0,held->b) with g,
+  or from nothing when held is NULL; g is kept when keep is set.
+  Returns the terms reused.
+*/
+static long
+batch_root(bs_t r,bs_t held,int keep,long threads)
+{
+  long t1 = held ? (long)held->b : 0;
+
+  if (terms<=0) {
+    bs_root(r,threads);
+    return 0;
+  }
+  if (t1==terms) {
+    bs_copy(r,held);
+    return t1;
+  }
+
+  bs_first = t1;
+  keep_g = keep;
+  engine->bs(r,threads);
+  keep_g = 0;
+  bs_first = 0;
+  if (t1) {
+    /* the merge takes held apart, so it works on a copy */
+    bs_t r1;
+
+    bs_init(r1);
+    bs_copy(r1,held);
+    bs_merge(r1,r,keep,threads);
+    bs_swap(r,r1);
+    bs_clear(r1);
+  }
+  r->a = 0;
+  r->b = terms;
+  return t1;
+}
+
+/*
+  runs jobs[0..n-1], shortest first, and gives each one's value as
+  x/2^shift to done(), with the terms its root reused; a nonzero return
+  of done() ends the batch with it
+*/
+int
+batch_run(const batch_job_t *jobs,int n,long threads,
+          int (*done)(int i,mpz_t x,long shift,long reused,void *arg),void *arg)
+{
+  bs_t held[BATCH_SERIES],root;
+  int have[BATCH_SERIES] = { 0 };
+  order_t *ord = malloc(n*sizeof(*ord));
+  long m,shift,reused;
+  int i,j,s,keep,r = 0;
+  mpz_t x,t;
+
+  if (!ord && n) {
+    fprintf(stderr,"%s: out of memory for %d jobs\n",prog_name,n);
+    exit(1);
+  }
+  for (i=0; i<n; i++) {
+    ord[i].digits = jobs[i].digits;
+    ord[i].i = i;
+  }
+  qsort(ord,n,sizeof(*ord),by_digits);
+
+  for (i=0; i<n && !r; i++) {
+    const batch_job_t *b = &jobs[ord[i].i];
+
+    series = b->series;
+    terms = series->terms(b->digits);
+    s = series_index(series);
+
+    /* does another job of this constant follow; it is no smaller */
+    for (keep=0, j=i+1; j<n && !keep; j++)
+      keep = jobs[ord[j].i].series==series;
+
+    bs_init(root);
+    reused = batch_root(root,have[s] ? held[s] : NULL,keep,threads);
+    if (have[s]) {
+      bs_clear(held[s]);
+      have[s] = 0;
+    }
+    if (keep && terms > 0) {
+      bs_init(held[s]);
+      bs_copy(held[s],root);
+      have[s] = 1;
+    }
+    mpz_clear(root->g);
+    fac_clear(root->fp);
+    fac_clear(root->fg);
+
+    m = (long)(b->digits*BITS_PER_DIGIT+16)+NEWTON_GUARD;
+    mpz_init(x);
+    mpz_init(t);
+    shift = final_div(root,x,t,m,threads);
+    shift = final_mul(root,x,t,shift,m,threads);
+    mpz_clear(t);
+    r = done(ord[i].i,x,shift,reused,arg);
+    mpz_clear(x);
+  }
+
+  for (s=0; s<BATCH_SERIES; s++)
+    if (have[s])
+      bs_clear(held[s]);
+  free(ord);
+  return r;
+}
+
+/*
+  the jobs of a batch file, one "<digits> [<constant>]" per line, with
+  def for the lines without a constant; # starts a comment.  Returns
+  how many there are in *jobs, or -1 with a message if a line is bad.
+*/
+int
+batch_read(const char *path,const series_t *def,batch_job_t **jobs)
+{
+  FILE *f = strcmp(path,"-")==0 ? stdin : fopen(path,"r");
+  char line[256],name[64],*c;
+  int n = 0,max = 0,k,no = 0,bad = 0;
+  long d;
+
+  *jobs = NULL;
+  if (!f) {
+    fprintf(stderr,"%s: cannot open '%s'\n",prog_name,path);
+    return -1;
+  }
+  while (!bad && fgets(line,sizeof(line),f)) {
+    no++;
+    if ((c = strchr(line,'#')))
+      *c = 0;
+    if ((k = sscanf(line,"%ld %63s",&d,name)) < 1) {
+      bad = sscanf(line," %1s",name)==1;
+      continue;
+    }
+    if (n==max) {
+      max = max ? 2*max : 64;
+      *jobs = realloc(*jobs,max*sizeof(**jobs));
+      if (!*jobs) {
+        fprintf(stderr,"%s: out of memory for %d jobs\n",prog_name,max);
+        exit(1);
+      }
+    }
+    (*jobs)[n].digits = d;
+    (*jobs)[n].series = k==2 ? find_series(name) : def;
+    bad = d < 1 || !(*jobs)[n].series;
+    n += !bad;
+  }
+  if (bad) {
+    fprintf(stderr,"%s: %s line %d: need <digits> [<constant>]\n",prog_name,path,no);
+    n = -1;
+  }
+  if (f!=stdin)
+    fclose(f);
+  return n;
+}
@@ -0,0 +1,812 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Copyright 2002,2005 Hanhong Xue (macroxue at yahoo dot com)
+
+ * Slightly modified 2005 by Torbjorn Granlund to allow more than 2G
+   digits to be computed.
+
+ * Leaf terms and merge step of the binary splitting, shared by all of the
+   parallel engines.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+////////////////////////////////////////////////////////////////////////////
+
+/* factored representation of p(a,b) and g(a,b), as in gmp-chudnovsky.
+
+   Every odd number below sieve_size is looked up in a sieve holding its
+   smallest prime factor, so the leaves can record the factorisation of
+   their terms.  Factors of two are never kept: g(a,b) is always odd. */
+
+#define FAC_BP_MAX  16    /* distinct primes of an unsigned long */
+
+static unsigned int *sieve;
+static unsigned long sieve_size,sieve_m;
+
+/* smallest prime factor of the odd number n */
+#define sieve_spf(n) (sieve[(n)/2] ? sieve[(n)/2] : (n))
+
+#define SIEVE_SEG  (1UL<<18)
+
+/* segments k = i, i+n, i+2n, ... above sqrt(sieve_size) */
+static void
+sieve_job(int i,void *arg)
+{
+  unsigned long p,j,lo,hi,k,nseg;
+  int n = *(int *)arg;
+
+  perf_thread();
+  nseg = (sieve_size-sieve_m)/SIEVE_SEG+1;
+  for (k=i; k<nseg; k+=n) {
+    lo = sieve_m+1+k*SIEVE_SEG;
+    hi = lo+SIEVE_SEG;
+    if (hi > sieve_size+1)
+      hi = sieve_size+1;
+    for (p=3; p<=sieve_m; p+=2) {
+      if (sieve[p/2])
+        continue;
+      j = (lo+p-1)/p*p;
+      if (j%2==0)
+        j += p;
+      if (j < p*p)
+        j = p*p;
+      for (; j<hi; j+=2*p)
+        if (sieve[j/2]==0)
+          sieve[j/2] = p;
+    }
+  }
+}
+
+void
+build_sieve(unsigned long n,long threads)
+{
+  unsigned long m,i,j;
+  int jobs;
+
+  sieve_size = n;
+  sieve = calloc(n/2+1,sizeof(*sieve));
+  m = (unsigned long)sqrt((double)n);
+  while (m*m > n)
+    m--;
+  while ((m+1)*(m+1) <= n)
+    m++;
+  sieve_m = m;
+
+  for (i=3; i<=m; i+=2)
+    if (sieve[i/2]==0)
+      for (j=i*i; j<=m; j+=2*i)
+        if (sieve[j/2]==0)
+          sieve[j/2] = i;
+
+  /* the rest is sieved in independent segments, smallest prime first */
+  jobs = threads;
+  engine->run(jobs,sieve_job,&jobs);
+}
+
+void
+free_sieve(void)
+{
+  free(sieve);
+  sieve = NULL;
+}
+
+void
+fac_init(fac_t f)
+{
+  f->max_facs = f->num_facs = 0;
+  f->fac = f->pow = NULL;
+}
+
+void
+fac_clear(fac_t f)
+{
+  free(f->fac);
+  free(f->pow);
+}
+
+static void
+fac_resize(fac_t f,unsigned long s)
+{
+  if (f->max_facs < s) {
+    if (s < 2*f->max_facs)
+      s = 2*f->max_facs;
+    f->fac = realloc(f->fac,s*sizeof(unsigned long));
+    f->pow = realloc(f->pow,s*sizeof(unsigned long));
+    f->max_facs = s;
+  }
+}
+
+/* f = base^pow, base odd */
+static void
+fac_set_bp(fac_t f,unsigned long base,unsigned long pow)
+{
+  unsigned long i,p;
+
+  assert(base < sieve_size);
+  fac_resize(f,FAC_BP_MAX);
+  for (i=0; base>1; i++) {
+    p = sieve_spf(base);
+    f->fac[i] = p;
+    f->pow[i] = 0;
+    do {
+      base /= p;
+      f->pow[i] += pow;
+    } while (base%p==0);
+  }
+  f->num_facs = i;
+}
+
+/* f = f*g, merged from the top so f can be updated in place */
+void
+fac_mul(fac_t f,fac_t g)
+{
+  unsigned long i,j,k,n;
+
+  for (i=j=n=0; i<f->num_facs && j<g->num_facs; n++) {
+    if (f->fac[i]==g->fac[j]) {
+      i++; j++;
+    } else if (f->fac[i]<g->fac[j]) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  n += (f->num_facs-i)+(g->num_facs-j);
+  fac_resize(f,n);
+
+  i = f->num_facs;
+  j = g->num_facs;
+  for (k=n; j>0; ) {
+    k--;
+    if (i>0 && f->fac[i-1]>g->fac[j-1]) {
+      i--;
+      f->fac[k] = f->fac[i];
+      f->pow[k] = f->pow[i];
+    } else if (i>0 && f->fac[i-1]==g->fac[j-1]) {
+      i--; j--;
+      f->fac[k] = f->fac[i];
+      f->pow[k] = f->pow[i]+g->pow[j];
+    } else {
+      j--;
+      f->fac[k] = g->fac[j];
+      f->pow[k] = g->pow[j];
+    }
+  }
+  f->num_facs = n;
+}
+
+/* f = f*base^pow, base odd */
+static void
+fac_mul_bp(fac_t f,unsigned long base,unsigned long pow)
+{
+  unsigned long fac[FAC_BP_MAX],pw[FAC_BP_MAX];
+  fac_t t;
+
+  t->max_facs = FAC_BP_MAX;
+  t->fac = fac;
+  t->pow = pw;
+  fac_set_bp(t,base,pow);
+  fac_mul(f,t);
+}
+
+/* drop the primes whose power went to zero */
+static void
+fac_compact(fac_t f)
+{
+  unsigned long i,j;
+
+  for (i=j=0; i<f->num_facs; i++) {
+    if (f->pow[i]>0) {
+      f->fac[j] = f->fac[i];
+      f->pow[j] = f->pow[i];
+      j++;
+    }
+  }
+  f->num_facs = j;
+}
+
+/* r = product of the prime powers f[lo..hi) */
+static void
+fac_prod(mpz_t r,fac_t f,unsigned long lo,unsigned long hi)
+{
+  mpz_t t;
+
+  if (hi-lo==1) {
+    mpz_ui_pow_ui(r,f->fac[lo],f->pow[lo]);
+  } else {
+    mpz_init(t);
+    fac_prod(r,f,lo,lo+(hi-lo)/2);
+    fac_prod(t,f,lo+(hi-lo)/2,hi);
+    mpz_mul(r,r,t);
+    mpz_clear(t);
+  }
+}
+
+/* r = the value of f, 1 if it has no factors */
+void
+fac_value(mpz_t r,fac_t f)
+{
+  if (f->num_facs)
+    fac_prod(r,f,0,f->num_facs);
+  else
+    mpz_set_ui(r,1);
+}
+
+/* divide p and g by their common factor, keeping fp and fg in step */
+void
+fac_remove_gcd(mpz_t p,fac_t fp,mpz_t g,fac_t fg)
+{
+  unsigned long i,j,k,c;
+  fac_t fmul;
+  mpz_t gcd;
+
+  fac_init(fmul);
+  fac_resize(fmul,fp->num_facs < fg->num_facs ? fp->num_facs : fg->num_facs);
+  for (i=j=k=0; i<fp->num_facs && j<fg->num_facs; ) {
+    if (fp->fac[i]==fg->fac[j]) {
+      c = fp->pow[i] < fg->pow[j] ? fp->pow[i] : fg->pow[j];
+      fp->pow[i] -= c;
+      fg->pow[j] -= c;
+      fmul->fac[k] = fp->fac[i];
+      fmul->pow[k] = c;
+      i++; j++; k++;
+    } else if (fp->fac[i]<fg->fac[j]) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  fmul->num_facs = k;
+
+  if (k) {
+    mpz_init(gcd);
+    fac_prod(gcd,fmul,0,k);
+    mpz_divexact(p,p,gcd);
+    mpz_divexact(g,g,gcd);
+    mpz_clear(gcd);
+    fac_compact(fp);
+    fac_compact(fg);
+  }
+  fac_clear(fmul);
+}
+
+/* factorisations of p(b-1,b) and g(b-1,b) */
+static void
+fac_term(unsigned long b,fac_t fp,fac_t fg)
+{
+  unsigned long i;
+
+  for (i=b; i%2==0; i/=2)
+    ;
+  fac_set_bp(fp,i,3);               /* b^3 */
+  fac_mul_bp(fp,3*5*23*29,3);       /* C^3/24 without its powers of two */
+  fp->pow[0]--;
+
+  fac_set_bp(fg,2*b-1,1);           /* 2b-1 */
+  fac_mul_bp(fg,6*b-1,1);           /* 6b-1 */
+  fac_mul_bp(fg,6*b-5,1);           /* 6b-5 */
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+void
+bs_init(bs_t r)
+{
+  mpz_init(r->p);
+  mpz_init(r->q);
+  mpz_init(r->g);
+  fac_init(r->fp);
+  fac_init(r->fg);
+  r->a = r->b = 0;
+  r->idle = 0;
+  r->spill = NULL;
+  r->zeros[0] = r->zeros[1] = r->zeros[2] = 0;
+  r->packed = 0;
+}
+
+void
+bs_clear(bs_t r)
+{
+  mpz_clear(r->p);
+  mpz_clear(r->q);
+  mpz_clear(r->g);
+  fac_clear(r->fp);
+  fac_clear(r->fg);
+}
+
+void
+bs_swap(bs_t r,bs_t s)
+{
+  bs_t t;
+
+  *t = *r;
+  *r = *s;
+  *s = *t;
+}
+
+void
+bs_leaf(unsigned long b,bs_t r)
+{
+  /*
+    g(b-1,b) = (6b-5)(2b-1)(6b-1)
+    p(b-1,b) = b^3 * C^3 / 24
+    q(b-1,b) = (-1)^b*g(b-1,b)*(A+Bb).
+  */
+
+  r->a = b-1;
+  r->b = b;
+  if (series->block) {
+    series->block(b-1,b,r);
+    return;
+  }
+
+  mpz_set_ui(r->p,b);
+  mpz_mul_ui(r->p,r->p,b);
+  mpz_mul_ui(r->p,r->p,b);
+  mpz_mul_ui(r->p,r->p,(C/24)*(C/24));
+  mpz_mul_ui(r->p,r->p,C*24);
+
+  mpz_set_ui(r->g,2*b-1);
+  mpz_mul_ui(r->g,r->g,6*b-1);
+  mpz_mul_ui(r->g,r->g,6*b-5);
+
+  mpz_set_ui(r->q,b);
+  mpz_mul_ui(r->q,r->q,B);
+  mpz_add_ui(r->q,r->q,A);
+  mpz_mul   (r->q,r->q,r->g);
+  if (b%2)
+    mpz_neg(r->q,r->q);
+
+  if (factor)
+    fac_term(b,r->fp,r->fg);
+}
+
+/*
+  Leaf kernel for a block of up to LEAF_TERMS terms, b-a <= LEAF_TERMS.
+  The block is folded in from the left, one term k at a time:
+
+    g' = g*(2k-1)(6k-1)(6k-5)
+    q' = q*p(k-1,k) + (-1)^k*(A+Bk)*g'
+    p' = p*k^3*C^3/24
+
+  Every step is a few mpn_mul_1 on limb arrays on the stack, so there is
+  no mpz call, allocation or normalisation inside the block.  Each term
+  adds at most one limb per factor, which bounds the arrays.  q is kept
+  as a magnitude and a sign.  The results go into r once, at the end.
+*/
+#define BLOCK_LIMBS  (6*LEAF_TERMS+4)
+
+/* {rp,n} *= v[0..k-1], returns the new size */
+mp_size_t
+mul_limbs(mp_ptr rp,mp_size_t n,const mp_limb_t *v,int k)
+{
+  mp_limb_t c;
+  int i;
+
+  for (i=0; i<k; i++) {
+    c = mpn_mul_1(rp,rp,n,v[i]);
+    if (c)
+      rp[n++] = c;
+  }
+  return n;
+}
+
+/* {q,*qn} with sign *qs += ts*{t,tn} */
+void
+add_signed(mp_ptr q,mp_size_t *qn,int *qs,mp_srcptr t,mp_size_t tn,int ts)
+{
+  mp_limb_t c;
+
+  if (*qn==0) {
+    mpn_copyi(q,t,tn);
+    *qn = tn;
+    *qs = ts;
+  } else if (*qs==ts) {
+    if (*qn >= tn) {
+      c = mpn_add(q,q,*qn,t,tn);
+    } else {
+      c = mpn_add(q,t,tn,q,*qn);
+      *qn = tn;
+    }
+    if (c)
+      q[(*qn)++] = c;
+  } else {
+    if (*qn > tn || (*qn==tn && mpn_cmp(q,t,tn) >= 0)) {
+      mpn_sub(q,q,*qn,t,tn);
+    } else {
+      mpn_sub(q,t,tn,q,*qn);
+      *qn = tn;
+      *qs = ts;
+    }
+    while (*qn > 0 && q[*qn-1]==0)
+      (*qn)--;
+  }
+}
+
+void
+set_limbs(mpz_t z,mp_srcptr l,mp_size_t n,int sign)
+{
+  mpn_copyi(mpz_limbs_write(z,n),l,n);
+  mpz_limbs_finish(z,sign < 0 ? -n : n);
+}
+
+static void
+block(unsigned long a,unsigned long b,bs_t r)
+{
+  mp_limb_t p[BLOCK_LIMBS],q[BLOCK_LIMBS],g[BLOCK_LIMBS],t[BLOCK_LIMBS];
+  mp_limb_t pv[5],gv[3],tv[2],c;
+  mp_size_t pn = 1,qn = 0,gn = 1,tn;
+  unsigned long k;
+  fac_t fp,fg;
+  int qs = 1;
+  double t0 = trace_now();
+
+  if (series->block) {
+    series->block(a,b,r);
+    r->a = a;
+    r->b = b;
+    trace_event(TRACE_LEAF,t0,a,b,mpz_sizeinbase(r->p,2),mpz_sizeinbase(r->g,2));
+    return;
+  }
+
+  p[0] = g[0] = 1;
+  pv[3] = (C/24)*(C/24);
+  pv[4] = C*24;
+  if (factor) {
+    fac_init(fp);
+    fac_init(fg);
+  }
+
+  for (k=a+1; k<=b; k++) {
+    gv[0] = 2*k-1;
+    gv[1] = 6*k-1;
+    gv[2] = 6*k-5;
+    gn = mul_limbs(g,gn,gv,3);
+
+    /* t = (A+Bk)*g' */
+    mpn_copyi(t,g,gn);
+    tv[0] = k;
+    tv[1] = B;
+    tn = mul_limbs(t,gn,tv,2);
+    c = mpn_addmul_1(t,g,gn,A);
+    if (tn > gn)
+      c = mpn_add_1(t+gn,t+gn,tn-gn,c);
+    if (c)
+      t[tn++] = c;
+
+    pv[0] = pv[1] = pv[2] = k;
+    if (qn)
+      qn = mul_limbs(q,qn,pv,5);
+    add_signed(q,&qn,&qs,t,tn,k%2 ? -1 : 1);
+    pn = mul_limbs(p,pn,pv,5);
+
+    if (factor) {
+      if (k==a+1) {
+        fac_term(k,r->fp,r->fg);
+      } else {
+        fac_term(k,fp,fg);
+        fac_mul(r->fp,fp);
+        fac_mul(r->fg,fg);
+      }
+    }
+  }
+
+  set_limbs(r->p,p,pn,1);
+  set_limbs(r->q,q,qn,qs);
+  set_limbs(r->g,g,gn,1);
+  if (factor) {
+    fac_clear(fp);
+    fac_clear(fg);
+  }
+  r->a = a;
+  r->b = b;
+  trace_event(TRACE_LEAF,t0,a,b,pn*GMP_NUMB_BITS,gn*GMP_NUMB_BITS);
+}
+
+/* the leaf block of terms a+1..b, charged to its level for --perf */
+void
+bs_block(unsigned long a,unsigned long b,bs_t r)
+{
+  int old = perf_enter(perf_on ? trace_level(a,b) : -1);
+
+  block(a,b,r);
+  perf_leave(old);
+}
+
+/* give the limbs of x back, keeping it usable */
+static void
+release(mpz_t x)
+{
+  mpz_clear(x);
+  mpz_init(x);
+}
+
+typedef struct {
+  bs_struct *r1,*r2;
+  mpz_srcptr p1,q1;
+  int tds;
+} merge_t;
+
+/* r = x*y, one of the products of merging r1 and r2, timed for the trace */
+static void
+merge_mul(int kind,mpz_ptr r,mpz_srcptr x,mpz_srcptr y,int tds,
+          bs_struct *r1,bs_struct *r2)
+{
+  double t0 = trace_now();
+  long bx = 0,by = 0;
+
+  if (trace_on) {
+    bx = mpz_sizeinbase(x,2);
+    by = mpz_sizeinbase(y,2);
+  }
+  pmul(r,x,y,tds);
+  trace_event(kind,t0,r1->a,r2->b,bx,by);
+}
+
+static void
+merge_job(int i,void *arg)
+{
+  merge_t *m = arg;
+
+  if (i==0)
+    merge_mul(TRACE_P1P2,m->r1->p,m->p1,m->r2->p,m->tds,m->r1,m->r2);
+  else if (i==1)
+    merge_mul(TRACE_Q1P2,m->r1->q,m->q1,m->r2->p,m->tds,m->r1,m->r2);
+  else if (i==2)
+    merge_mul(TRACE_Q2G1,m->r2->q,m->r2->q,m->r1->g,m->tds,m->r1,m->r2);
+  else
+    merge_mul(TRACE_G1G2,m->r2->g,m->r2->g,m->r1->g,m->tds,m->r1,m->r2);
+}
+
+/*
+  p(a,b) = p(a,m) * p(m,b)
+  g(a,b) = g(a,m) * g(m,b)
+  q(a,b) = q(a,m) * p(m,b) + q(m,b) * g(a,m)
+
+  r1 holds (a,m) on entry and (a,b) on return, r2 holds (m,b) and is
+  clobbered.  g(a,b) is only formed when gflag is set: a node needs its g
+  unless it is on the right spine of the tree, b == terms, because only
+  a left child's g goes into q.  Without gflag, the g operands of both
+  halves are freed as soon as q has been formed.  With tds workers
+  the three products run side by side, and a third of the workers go into
+  each product once it is big enough for pmul to split.  With four or
+  more workers g1*g2 joins them, formed in r2->g so that g1 stays intact
+  for q2*g1.
+
+  With lowmem set a serial merge goes q1*p2, p1*p2, q1 += q2*g1, g1*g2
+  instead, and each operand of r2 is freed the moment it is used up, so
+  r2 keeps no limbs when it returns.
+
+  p and q of r1 are read from its spill file if bs_spill sent it to disk.
+  r2 is written to, so it is brought back in full; only a chunk result
+  of the forloop and cilk reductions can be spilled there.
+*/
+static void
+merge(bs_t r1,bs_t r2,int gflag,int tds)
+{
+  mpz_srcptr p1,q1;
+  merge_t m;
+  int g4 = 0;
+
+  spill_get(r1,&p1,&q1);
+  spill_back(r2);
+  if (factor)
+    fac_remove_gcd(r2->p,r2->fp,r1->g,r1->fg);
+
+  if (lowmem && tds < 3) {
+    merge_mul(TRACE_Q1P2,r1->q,q1,r2->p,tds,r1,r2);
+    merge_mul(TRACE_P1P2,r1->p,p1,r2->p,tds,r1,r2);
+    spill_put(r1);
+    release(r2->p);
+    if (tds < 2) {
+      double t0 = trace_now();
+
+      mpz_addmul(r1->q,r2->q,r1->g);
+      if (trace_on)
+        trace_event(TRACE_Q2G1,t0,r1->a,r2->b,mpz_sizeinbase(r2->q,2),
+                    mpz_sizeinbase(r1->g,2));
+    } else {
+      merge_mul(TRACE_Q2G1,r2->q,r2->q,r1->g,tds,r1,r2);
+      mpz_add(r1->q,r1->q,r2->q);
+    }
+    release(r2->q);
+    if (gflag)
+      merge_mul(TRACE_G1G2,r1->g,r1->g,r2->g,tds,r1,r2);
+    else
+      release(r1->g);
+    release(r2->g);
+    if (factor) {
+      fac_mul(r1->fp,r2->fp);
+      if (gflag) {
+        fac_mul(r1->fg,r2->fg);
+      } else {
+        fac_clear(r1->fg);
+        fac_init(r1->fg);
+      }
+      fac_clear(r2->fp);
+      fac_clear(r2->fg);
+      fac_init(r2->fp);
+      fac_init(r2->fg);
+    }
+    r1->b = r2->b;
+    return;
+  }
+
+  if (tds < 3) {
+    merge_mul(TRACE_P1P2,r1->p,p1,r2->p,tds,r1,r2);
+    merge_mul(TRACE_Q1P2,r1->q,q1,r2->p,tds,r1,r2);
+    merge_mul(TRACE_Q2G1,r2->q,r2->q,r1->g,tds,r1,r2);
+  } else {
+    m.r1 = r1;
+    m.r2 = r2;
+    m.p1 = p1;
+    m.q1 = q1;
+    if (gflag && tds >= 4) {
+      m.tds = tds/4;
+      engine->run(4,merge_job,&m);
+      mpz_swap(r1->g,r2->g);
+      g4 = 1;
+    } else {
+      m.tds = tds/3;
+      engine->run(3,merge_job,&m);
+    }
+  }
+  spill_put(r1);
+  if (lowmem)
+    release(r2->p);
+  mpz_add(r1->q,r1->q,r2->q);
+  if (lowmem)
+    release(r2->q);
+  if (gflag && !g4)
+    merge_mul(TRACE_G1G2,r1->g,r1->g,r2->g,tds,r1,r2);
+  if (!gflag) {
+    release(r1->g);
+    release(r2->g);
+  } else if (lowmem) {
+    release(r2->g);
+  }
+
+  if (factor) {
+    fac_mul(r1->fp,r2->fp);
+    if (gflag) {
+      fac_mul(r1->fg,r2->fg);
+    } else {
+      fac_clear(r1->fg);
+      fac_init(r1->fg);
+    }
+  }
+  r1->b = r2->b;
+}
+
+void
+bs_merge(bs_t r1,bs_t r2,int gflag,int tds)
+{
+  int old = perf_enter(perf_on ? trace_level(r1->a,r2->b) : -1);
+
+  merge(r1,r2,gflag,tds);
+  perf_leave(old);
+}
+
+/* where the engines split [a,b), b-a >= 2: both halves keep a term */
+unsigned long
+bs_split(unsigned long a,unsigned long b)
+{
+  unsigned long mid = a+(b-a)*split_ratio;
+
+  if (mid <= a)
+    mid = a+1;
+  if (mid >= b)
+    mid = b-1;
+  return mid;
+}
+
+/* the longest chain of right halves below n terms, plus one */
+long
+bs_depth(unsigned long n)
+{
+  long d = 1;
+
+  while (n > 1) {
+    n -= bs_split(0,n);
+    d++;
+  }
+  return d;
+}
+
+/*
+  Chunk partition for the forloop and cilk engines.  p, q and g of term
+  k have about bits_log*log2(k)+bits_one bits each, from the series, so
+  an interval [a,b) holds s = bits(b)-bits(a) bits, and splitting it
+  costs about s*log2(s).  The edges are placed so that no chunk is
+  estimated above the cost limit, which is bisected down to the
+  smallest that still fits in n chunks.
+*/
+static double
+bits(double x)
+{
+  return series->bits_log*((x+1)*log(x+1)-x)/M_LN2+series->bits_one*x;
+}
+
+static double
+cost(unsigned long a,unsigned long b)
+{
+  double s = bits(b)-bits(a);
+
+  return s*log2(s+2);
+}
+
+/* the greedy chunks under the limit, 1 when they reach the end in n */
+static int
+fill(unsigned long *edge,long n,double limit)
+{
+  unsigned long lo,hi,m;
+  long i;
+
+  edge[0] = bs_first;
+  for (i=1; i<n; i++) {
+    lo = edge[i-1]+1;           /* every chunk gets a term */
+    hi = terms-(n-i);
+    while (lo < hi) {
+      m = lo+(hi-lo+1)/2;
+      if (cost(edge[i-1],m) <= limit)
+        lo = m;
+      else
+        hi = m-1;
+    }
+    edge[i] = lo;
+  }
+  edge[n] = terms;
+  return cost(edge[n-1],terms) <= limit;
+}
+
+/* edge[0..n] cut [bs_first,terms) into n chunks of about equal cost,
+   n <= terms-bs_first */
+void
+bs_partition(unsigned long *edge,long n)
+{
+  double lo = 0,hi = cost(bs_first,terms);
+  int i;
+
+  for (i=0; i<50; i++) {
+    if (fill(edge,n,(lo+hi)/2))
+      hi = (lo+hi)/2;
+    else
+      lo = (lo+hi)/2;
+  }
+  fill(edge,n,hi);
+}
+
+void
+run_serial(int n,void (*job)(int,void *),void *arg)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    job(i,arg);
+}
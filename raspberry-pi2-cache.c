@@ -0,0 +1,385 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * A cache of results, on with --cache=<dir>.  <dir>/<name>.packed holds
+   the most digits of the constant computed so far, in the packed format
+   of --format=packed, and <dir>/<name>.root the root of that run for
+   --extend.  A run for d digits with no more than those is answered from
+   the packed file without computing anything: it is mapped, and
+
+     packed  the header is written new and the words go out with sendfile,
+             all but the ones the rounding of the last digit changes
+     text    the words are unpacked into the text that goes to stdout
+
+   The last digit is rounded on the digits after it, so the answer is the
+   same as the one a run of its own gives; when those are 5 and zeros,
+   which the rounding of the cached last digit may have made, the cache
+   cannot tell and it is a miss.  On a miss the run extends the saved
+   root to d digits, writes them packed, answers from that file the same
+   way and then, if it has more digits, puts it in place of the old one.
+   Both files are written under a temporary name of their own, made by
+   mkstemp, and renamed, so concurrent runs on one cache only ever see
+   whole files.  Two misses at once both land; the one renamed last
+   stays, which is as good a cache.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define PACK_MAGIC  "#raspberry-pi2 packed digits\n"
+#define WORD_MAX    10000000000000000000ULL     /* 10^PACK_DIGITS */
+
+/* a packed file being read */
+typedef struct {
+  int fd;
+  unsigned char *map;
+  size_t size;
+  unsigned long whole;          /* FirstDigits */
+  long frac;                    /* TotalDigits, digits after the point */
+} packed_t;
+
+static char *
+cache_path(const char *dir,const char *suffix)
+{
+  char *path = malloc(strlen(dir)+strlen(series->name)+32);
+
+  sprintf(path,"%s/%s%s",dir,series->name,suffix);
+  return path;
+}
+
+/* the root file of --extend in dir, for this constant and option 4 */
+char *
+cache_root(const char *dir)
+{
+  return cache_path(dir,factor ? "-4.root" : ".root");
+}
+
+static void
+cache_error(const char *what,const char *path)
+{
+  fprintf(stderr,"%s: %s '%s': ",prog_name,what,path);
+  perror(NULL);
+  exit(1);
+}
+
+/* map the packed file at path; 0 if there is no usable one */
+static int
+packed_open(packed_t *c,const char *path)
+{
+  struct stat st;
+  const char *s;
+
+  c->map = NULL;
+  c->fd = open(path,O_RDONLY);
+  if (c->fd < 0)
+    return 0;
+  if (fstat(c->fd,&st) < 0 || st.st_size < PACK_HEADER)
+    goto bad;
+  c->size = st.st_size;
+  c->map = mmap(NULL,c->size,PROT_READ,MAP_SHARED,c->fd,0);
+  if (c->map==MAP_FAILED) {
+    c->map = NULL;
+    goto bad;
+  }
+  s = (const char *)c->map;
+  if (memcmp(s,PACK_MAGIC,strlen(PACK_MAGIC))!=0 || memchr(s,0,PACK_HEADER)==NULL ||
+      !strstr(s,"FirstDigits: ") || !strstr(s,"TotalDigits: ") ||
+      sscanf(strstr(s,"FirstDigits: "),"FirstDigits: %lu.",&c->whole)!=1 ||
+      sscanf(strstr(s,"TotalDigits: "),"TotalDigits: %ld",&c->frac)!=1 ||
+      c->frac < 0 ||
+      c->size < PACK_HEADER+8*(size_t)((c->frac+PACK_DIGITS-1)/PACK_DIGITS))
+    goto bad;
+  return 1;
+
+ bad:
+  if (c->map)
+    munmap(c->map,c->size);
+  close(c->fd);
+  return 0;
+}
+
+static void
+packed_close(packed_t *c)
+{
+  munmap(c->map,c->size);
+  close(c->fd);
+}
+
+static uint64_t
+word(const packed_t *c,long i)
+{
+  const unsigned char *p = c->map+PACK_HEADER+8*i;
+  uint64_t w = 0;
+  int j;
+
+  for (j=7; j>=0; j--)
+    w = w<<8 | p[j];
+  return w;
+}
+
+static void
+put_word(char *p,uint64_t w)
+{
+  int j;
+
+  for (j=0; j<8; j++)
+    p[j] = (char)(w>>(8*j));
+}
+
+/* digit i after the point */
+static int
+digit(const packed_t *c,long i)
+{
+  uint64_t w = word(c,i/PACK_DIGITS);
+  int j;
+
+  for (j=i%PACK_DIGITS; j<PACK_DIGITS-1; j++)
+    w /= 10;
+  return (int)(w%10);
+}
+
+/*
+  can the digits be rounded to n after the point the same way as the
+  value?  The last cached digit is rounded already, so a cached tail of
+  5 and then zeros might have been 4999... before.
+*/
+static int
+exact(const packed_t *c,long n)
+{
+  long i;
+
+  if (n==c->frac || digit(c,n)!=5)
+    return 1;
+  for (i=n+1; i<c->frac; i++)
+    if (digit(c,i))
+      return 1;
+  return 0;
+}
+
+/*
+  the first n digits after the point, rounded, as packed words: words
+  [0,*k) are the cached ones, (*rest)[*k..] the ones rounding changed,
+  and *whole gets a carry out of the first word.  Returns the words.
+*/
+static long
+round_words(const packed_t *c,long n,unsigned long *whole,uint64_t **rest,long *k)
+{
+  long words = (n+PACK_DIGITS-1)/PACK_DIGITS,i;
+  int up = n < c->frac && digit(c,n) >= 5;
+  uint64_t unit = 1,*v;
+
+  *whole = c->whole;
+  *rest = NULL;
+  *k = 0;
+  if (words==0) {
+    *whole += up;
+    return 0;
+  }
+  for (i=n; i<words*PACK_DIGITS; i++)
+    unit *= 10;
+
+  /* the last word is cut after digit n, then the carry goes up */
+  v = malloc(words*sizeof(*v));
+  i = words-1;
+  v[i] = word(c,i)/unit*unit;
+  while (up) {
+    v[i] += unit;
+    if (v[i] < WORD_MAX)
+      break;
+    v[i] -= WORD_MAX;
+    if (i==0) {
+      (*whole)++;
+      break;
+    }
+    i--;
+    v[i] = word(c,i);
+    unit = 1;
+  }
+  *k = i;
+  *rest = v;
+  return words;
+}
+
+/* write n bytes to fd from the file at off, by sendfile or from the map */
+static void
+send_bytes(int fd,const packed_t *c,off_t off,size_t n,const char *path)
+{
+  ssize_t r;
+
+  while (n > 0) {
+    r = sendfile(fd,c->fd,&off,n);
+    if (r < 0 && (errno==EINVAL || errno==ENOSYS))
+      break;
+    if (r <= 0)
+      cache_error("cannot write",path);
+    n -= r;
+  }
+  while (n > 0) {
+    r = write(fd,c->map+off,n);
+    if (r <= 0)
+      cache_error("cannot write",path);
+    off += r;
+    n -= r;
+  }
+}
+
+static void
+write_bytes(int fd,const char *p,size_t n,const char *path)
+{
+  ssize_t r;
+
+  while (n > 0) {
+    r = write(fd,p,n);
+    if (r <= 0)
+      cache_error("cannot write",path);
+    p += r;
+    n -= r;
+  }
+}
+
+/* the digits of a run for d digits, from the map, hashed if check */
+static void
+serve(digits_t *o,const packed_t *c,long d,int check)
+{
+  long frac = d-series->e10,words,k,i,j;
+  const char *path = o->path ? o->path : "stdout";
+  unsigned long whole;
+  uint64_t *rest,w;
+  char head[PACK_HEADER],*p;
+  int fd = o->fd < 0 ? 1 : o->fd;
+
+  words = round_words(c,frac,&whole,&rest,&k);
+  if (o->format==OUT_PACKED) {
+
+    memset(head,0,PACK_HEADER);
+    snprintf(head,PACK_HEADER,
+      "#raspberry-pi2 packed digits\nBase: 10\nDigitsPerWord: %d\n"
+      "FirstDigits: %lu.\nTotalDigits: %ld\nTerms: %ld\n",
+      PACK_DIGITS,whole,frac,terms);
+    write_bytes(fd,head,PACK_HEADER,path);
+    send_bytes(fd,c,PACK_HEADER,8*k,path);
+    p = malloc(8*(words-k)+1);
+    for (i=k; i<words; i++)
+      put_word(p+8*(i-k),rest[i]);
+    write_bytes(fd,p,8*(words-k),path);
+    free(p);
+    o->buf = NULL;
+    o->len = o->fd < 0 ? 0 : PACK_HEADER+8*words;
+    if (check)
+      verify_digits((const char *)c->map+PACK_HEADER,frac,OUT_PACKED);
+
+  } else {
+
+    /* 0.314...e1 with the trailing zeros dropped, as digits_write() */
+    digits_map(o,d+64);
+    o->len = sprintf(o->buf,"%s(0,%ld)=\n0.",series->name,terms);
+    p = o->buf+o->len;
+    if (series->e10)
+      p += sprintf(p,"%lu",whole);
+    for (i=0; i<words; i++) {
+      w = i < k ? word(c,i) : rest[i];
+      for (j=PACK_DIGITS-1; j>=0; j--, w/=10)
+        if (i*PACK_DIGITS+j < frac)
+          p[i*PACK_DIGITS+j] = '0'+w%10;
+    }
+    if (check)
+      verify_digits(o->buf+o->len,d,OUT_TEXT);
+    o->len += d;
+    while (o->buf[o->len-1]=='0')
+      o->len--;
+    o->len += sprintf(o->buf+o->len,"e%d\n",series->e10);
+
+  }
+  free(rest);
+}
+
+/* the digits of a run for d digits from the cache in dir, 0 if it has
+   too few or cannot round them */
+int
+cache_serve(const char *dir,long d,digits_t *o)
+{
+  char *path = cache_path(dir,".packed");
+  packed_t c;
+  int hit = 0;
+
+  if (packed_open(&c,path)) {
+    if (d-series->e10 <= c.frac && exact(&c,d-series->e10)) {
+      serve(o,&c,d,verify_on);
+      hit = 1;
+    }
+    packed_close(&c);
+  }
+  free(path);
+  return hit;
+}
+
+/*
+  keep the constant = x/2^shift to d digits in dir, unless a run in
+  between left more there, and write them to o if it is not NULL; x is
+  destroyed
+*/
+void
+cache_store(const char *dir,mpz_t x,long shift,long d,digits_t *o,long threads)
+{
+  char *path = cache_path(dir,".packed"),*tmp = temp_file(path);
+  digits_t p;
+  packed_t c;
+  long have = -1;
+
+  if (!tmp)
+    cache_error("cannot write",path);
+  digits_open(&p,tmp,OUT_PACKED);
+  digits_write(&p,x,shift,d,threads);
+  digits_close(&p);
+  if (o) {
+    if (!packed_open(&c,tmp))
+      cache_error("cannot read back",tmp);
+    serve(o,&c,d,0);
+    packed_close(&c);
+  }
+
+  if (packed_open(&c,path)) {
+    have = c.frac;
+    packed_close(&c);
+  }
+  if (have >= d-series->e10 || rename(tmp,path)!=0) {
+    /* a run in between may have put at least as much there */
+    if (have < d-series->e10 && packed_open(&c,path)) {
+      have = c.frac;
+      packed_close(&c);
+    }
+    unlink(tmp);
+    if (have < d-series->e10)
+      cache_error("cannot write",path);
+  }
+  free(tmp);
+  free(path);
+}
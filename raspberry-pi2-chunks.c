@@ -0,0 +1,303 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Copyright 2002, 2005 Hanhong Xue (macroxue at yahoo dot com)
+
+ * Modifed 2008 by David Carver (dcarver at tacc dot utexas dot edu) to enable
+   multi-threading using the algorithm from "Computation of High-Precision 
+   Mathematical Constants in a Combined Cluster and Grid Environment" by 
+   Daisuke Takahashi, Mitsuhisa Sato, and Taisuke Boku.  
+
+ * The chunked splitting of the forloop and cilk engines: [0,terms) is
+   cut into --chunks chunks per thread of about equal estimated cost,
+   the chunks are summed by a loop the engine supplies, then folded by
+   a pairwise reduction on engine->run.  Chunks and reduction results
+   are checkpointed here, and loaded back on a restart.  Every result
+   but the root is handed to bs_spill() as soon as it is done, since it
+   waits for the reduction to merge it, and --memory and --compress
+   count the chunk results that wait between bs1 and bs2 too.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+////////////////////////////////////////////////////////////////////////////
+
+static bs_t   **stack;
+static long int depth;
+static long int nchunks;
+static unsigned long *bound;
+
+/* first term of chunk i, chunks i..j-1 cover [edge(i),edge(j)) */
+static unsigned long
+edge(long i)
+{
+  return i < nchunks ? bound[i] : terms;
+}
+
+/* the result in stack[i][0] covers chunks i..have[i]-1, 0 while none */
+static long *have;
+
+typedef struct {
+  long lo, hi;
+  int tds;
+} reduce_t;
+
+// binary splitting
+static void sum(unsigned long i, unsigned long j, unsigned long gflag, int tds)
+{
+  bs_merge(stack[i][0], stack[j][0], gflag, tds);
+}
+static void bs(unsigned long a, unsigned long b, unsigned long gflag, 
+        unsigned long index, unsigned long top)
+{
+  unsigned long mid;
+
+  if (b-a <= LEAF_TERMS) {
+    bs_block(a, b, stack[index][top]);
+  } else {
+    /*
+      p(a,b) = p(a,m) * p(m,b)
+      g(a,b) = g(a,m) * g(m,b)
+      q(a,b) = q(a,m) * p(m,b) + q(m,b) * g(a,m)
+    */
+    mid = bs_split(a, b);
+    bs(a, mid, 1, index, top);
+    bs_spill(stack[index][top]);
+
+    bs(mid, b, gflag, index, top+1);
+
+    bs_merge(stack[index][top], stack[index][top+1], gflag, 1);
+  }
+}
+
+/* where chunks lo..hi-1 split in the reduction tree, the left half bigger */
+static long
+split(long lo, long hi)
+{
+  return lo+(hi-lo+1)/2;
+}
+
+/* free the stack of chunk j, of which the first n entries are in use */
+static void
+drop_stack(long j, long n)
+{
+  long i;
+
+  for (i = 0; i < n; i++)
+    bs_clear(stack[j][i]);
+  free(stack[j]);
+  stack[j] = NULL;
+}
+
+/*
+  Load the biggest saved intervals of the reduction tree; a chunk inside
+  a loaded interval other than its first gives up its stack.
+*/
+static void
+load(long lo, long hi)
+{
+  long j, mid;
+
+  if (ckpt_load(edge(lo), edge(hi), stack[lo][0])) {
+    have[lo] = hi;
+    if (hi-lo < nchunks)
+      bs_spill(stack[lo][0]);
+    for (j = lo+1; j < hi; j++)
+      drop_stack(j, depth);
+  } else if (hi-lo > 1) {
+    mid = split(lo, hi);
+    load(lo, mid);
+    load(mid, hi);
+  }
+}
+
+static void reduce(long lo, long hi, int tds);
+
+static void
+reduce_job(int i, void *arg)
+{
+  reduce_t *half = arg;
+
+  reduce(half[i].lo, half[i].hi, half[i].tds);
+}
+
+/*
+  stack[lo][0] = the result of chunks lo..hi-1 with tds threads.  Both
+  halves run side by side with the threads split by their number of
+  chunks, so any chunk count folds into a balanced tree, and each merge
+  gets all the threads of its subtree for its products.
+*/
+static void
+reduce(long lo, long hi, int tds)
+{
+  reduce_t half[2];
+  long mid;
+
+  if (have[lo] == hi)
+    return;
+  mid = split(lo, hi);
+  half[0].lo = lo;
+  half[0].hi = mid;
+  half[1].lo = mid;
+  half[1].hi = hi;
+  half[0].tds = tds*cpu_factor(mid-lo,hi-lo);
+  if (half[0].tds < 1)
+    half[0].tds = 1;
+  half[1].tds = tds-half[0].tds > 1 ? tds-half[0].tds : 1;
+  if (tds > 1) {
+    engine->run(2, reduce_job, half);
+  } else {
+    reduce_job(0, half);
+    reduce_job(1, half);
+  }
+
+  sum(lo, mid, hi < nchunks || keep_g, tds);
+  ckpt_save(edge(lo), edge(hi), stack[lo][0]);
+  ckpt_drop(edge(lo), edge(mid));
+  ckpt_drop(edge(mid), edge(hi));
+  have[lo] = hi;
+  /* it waits for its sibling unless it is the root */
+  if (hi-lo < nchunks)
+    bs_spill(stack[lo][0]);
+  drop_stack(mid, 1);
+}
+
+/* wall time and chunks of each worker, for the imbalance report */
+static double *busy;
+static long *done;
+
+/* the loop body: chunk i on worker w */
+static void
+chunk(long i, long w)
+{
+  double t;
+
+  if (stack[i] && have[i] == 0) {
+    t = wall_clock();
+    bs(edge(i), edge(i+1), BS_GFLAG(edge(i+1)), i, 0);
+    busy[w] += wall_clock()-t;
+    done[w]++;
+    ckpt_save(edge(i), edge(i+1), stack[i][0]);
+    have[i] = i+1;
+    /* and waits from here to its merge in the reduction */
+    if (nchunks > 1)
+      bs_spill(stack[i][0]);
+  }
+}
+
+/*
+  r = the root of [bs_first,terms) with threads threads.  loop(n,
+  threads, body) runs body(i, w) for every chunk i < n, w the worker
+  that runs it, below workers.
+*/
+void
+chunks_bs(bs_t r, long threads, long workers,
+          void (*loop)(long n, long threads, void (*body)(long i, long w)))
+{
+  long int i, j;
+  double begin, mid0, mid1;
+  uint64_t pv[PERF_EVENTS];
+  double wbegin, wmid0, wmid1;
+
+  /* no terms to split is no chunks at all: the empty product */
+  if (terms-(long)bs_first <= 0) {
+    mpz_set_ui(r->p, 1);
+    mpz_set_ui(r->q, 0);
+    mpz_set_ui(r->g, 1);
+    return;
+  }
+  if (terms-(long)bs_first < threads) {
+    if (verbose) {
+        fprintf(stderr,"Number of threads reset from %ld to %ld\n",threads,terms-(long)bs_first); 
+        fflush(stderr);
+    }
+	threads = terms-bs_first;
+  }
+  nchunks = threads*chunks_per_thread;
+  if (nchunks > terms-(long)bs_first)
+    nchunks = terms-bs_first;
+  depth = bs_depth(terms);
+
+  begin = cpu_time();
+  wbegin = wall_clock();
+  perf_total(pv);
+
+  /* allocate stacks */
+  stack = malloc(sizeof(bs_t *)*nchunks);
+  for (j = 0; j < nchunks; j++) {
+    stack[j] = malloc(sizeof(bs_t)*depth);
+    for (i = 0; i < depth; i++)
+      bs_init(stack[j][i]);
+  }
+
+  /* begin binary splitting process, chunks of about equal cost */
+  bound = malloc(sizeof(unsigned long)*(nchunks+1));
+  bs_partition(bound, nchunks);
+
+  have = calloc(nchunks, sizeof(long));
+  load(0, nchunks);
+
+  if (workers < threads)
+    workers = threads;
+  busy = calloc(workers, sizeof(double));
+  done = calloc(workers, sizeof(long));
+
+  loop(nchunks, threads, chunk);
+  for (j = 0; j < nchunks; j++) {
+    for (i=1; i<depth && stack[j]; i++)
+      bs_clear(stack[j][i]);
+  }
+
+  mid0 = cpu_time();
+  wmid0 = wall_clock();
+  perf_phase("bs1",pv);
+  perf_total(pv);
+  if (verbose) {
+    fprintf(stderr,"bs1        cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+      mid0-begin,wmid0-wbegin,cpu_factor(mid0-begin,wmid0-wbegin));
+    if (threads > 1)
+      for (j = 0; j < workers; j++)
+        if (j < threads || done[j])
+          fprintf(stderr,"   thread %3ld                 wallclock = %8.2f   chunks = %ld\n",
+            j,busy[j],done[j]);
+  }
+  free(busy);
+  free(done);
+
+  reduce(0, nchunks, threads);
+
+  mid1 = cpu_time();
+  wmid1 = wall_clock();
+  perf_phase("bs2",pv);
+  if (verbose)
+    fprintf(stderr,"bs2        cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+      mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+
+  bs_swap(r, stack[0][0]);
+  bs_clear(stack[0][0]);
+  free(stack[0]);
+  free(stack);
+  free(have);
+  free(bound);
+}
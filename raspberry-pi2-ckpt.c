@@ -0,0 +1,322 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Checkpoints of finished intervals, on with --checkpoint=<dir>.  The
+   forloop and cilk engines save every chunk result and every result of
+   the pairwise reduction as <dir>/bs-<a>-<b>.ckpt: the header, then p, q
+   and g with mpz_out_raw, then the factored forms of p and g when
+   factoring is on.  A file is written under a temporary name, synced
+   and renamed, so a crash never leaves half of one behind.  On restart
+   the engine loads the biggest saved intervals and only computes what
+   is missing.  The header says whether g was kept; a node on the right
+   spine saved without it is not loaded by a run that needs g there.
+   Once a reduction result is saved the two it was made of are removed,
+   and a finished run removes the rest of its own, so the directory holds
+   about one copy of the root at a time.
+
+ * --extend=<file> keeps the root of a whole run in the same format: p, q
+   and g of [0,terms) for its own terms, never without g.  A later run for more digits
+   loads it and only computes the terms past it, see bs_extend().
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define CKPT_MAGIC  "rpi2ckp2"
+
+const char *ckpt_dir = NULL;
+
+/* what a checkpoint says about itself; the rest of the run must agree */
+typedef struct {
+  char magic[8];
+  long terms,factor,series,a,b;
+  long gflag;                   /* g was kept, 0 for a right spine node */
+} ckpt_head_t;
+
+static char *
+ckpt_path(unsigned long a,unsigned long b,const char *suffix)
+{
+  char *path = malloc(strlen(ckpt_dir)+64);
+
+  sprintf(path,"%s/bs-%lu-%lu.ckpt%s",ckpt_dir,a,b,suffix);
+  return path;
+}
+
+static int
+fac_out(FILE *f,fac_t x)
+{
+  return fwrite(&x->num_facs,sizeof(x->num_facs),1,f)==1 &&
+    fwrite(x->fac,sizeof(*x->fac),x->num_facs,f)==x->num_facs &&
+    fwrite(x->pow,sizeof(*x->pow),x->num_facs,f)==x->num_facs;
+}
+
+static int
+fac_inp(FILE *f,fac_t x)
+{
+  unsigned long n;
+
+  if (fread(&n,sizeof(n),1,f)!=1 || n > (1UL<<40))
+    return 0;
+  fac_clear(x);
+  fac_init(x);
+  x->fac = malloc((n ? n : 1)*sizeof(*x->fac));
+  x->pow = malloc((n ? n : 1)*sizeof(*x->pow));
+  x->max_facs = x->num_facs = n;
+  return fread(x->fac,sizeof(*x->fac),n,f)==n &&
+    fread(x->pow,sizeof(*x->pow),n,f)==n;
+}
+
+/* write r = (p,q,g) of [a,b) to tmp, then rename it to path; 0 if it
+   could not be, with a message */
+static int
+ckpt_write(const char *path,const char *tmp,long n,unsigned long a,
+           unsigned long b,bs_t r)
+{
+  ckpt_head_t h;
+  FILE *f;
+  int ok;
+
+  memcpy(h.magic,CKPT_MAGIC,sizeof(h.magic));
+  h.terms = n;
+  h.factor = factor;
+  h.series = series->id;
+  h.a = a;
+  h.b = b;
+  h.gflag = mpz_sgn(r->g)!=0;
+
+  if (!(f = fopen(tmp,"wb"))) {
+    fprintf(stderr,"%s: cannot write checkpoint '%s'\n",prog_name,tmp);
+    return 0;
+  }
+  ok = fwrite(&h,sizeof(h),1,f)==1 &&
+    mpz_out_raw(f,r->p) && mpz_out_raw(f,r->q) && mpz_out_raw(f,r->g);
+  if (ok && factor)
+    ok = fac_out(f,r->fp) && fac_out(f,r->fg);
+  ok = ok && fflush(f)==0 && fsync(fileno(f))==0;
+  if (fclose(f)!=0 || !ok || rename(tmp,path)!=0) {
+    fprintf(stderr,"%s: cannot write checkpoint '%s'\n",prog_name,path);
+    remove(tmp);
+    return 0;
+  }
+  return 1;
+}
+
+/* the header h of path, if it is a checkpoint of this series with the
+   same factor setting; the numbers follow in f */
+static FILE *
+ckpt_head(const char *path,ckpt_head_t *h)
+{
+  FILE *f = fopen(path,"rb");
+
+  if (f && (fread(h,sizeof(*h),1,f)!=1 ||
+            memcmp(h->magic,CKPT_MAGIC,sizeof(h->magic))!=0 ||
+            h->factor!=factor || h->series!=series->id)) {
+    fclose(f);
+    f = NULL;
+  }
+  return f;
+}
+
+/* r = (p,q,g) of the checkpoint f */
+static int
+ckpt_body(FILE *f,bs_t r)
+{
+  int ok;
+
+  ok = mpz_inp_raw(r->p,f) && mpz_inp_raw(r->q,f) && mpz_inp_raw(r->g,f);
+  if (ok && factor)
+    ok = fac_inp(f,r->fp) && fac_inp(f,r->fg);
+  fclose(f);
+  return ok;
+}
+
+/* save r = (p,q,g) of [a,b) */
+void
+ckpt_save(unsigned long a,unsigned long b,bs_t r)
+{
+  char *path,*tmp;
+
+  if (!ckpt_dir)
+    return;
+  path = ckpt_path(a,b,"");
+  tmp = ckpt_path(a,b,".tmp");
+  if (!ckpt_write(path,tmp,terms,a,b,r))
+    exit(1);
+  free(tmp);
+  free(path);
+}
+
+/* remove the checkpoint of [a,b), now inside a saved bigger one */
+void
+ckpt_drop(unsigned long a,unsigned long b)
+{
+  char *path;
+
+  if (!ckpt_dir)
+    return;
+  path = ckpt_path(a,b,"");
+  unlink(path);
+  free(path);
+}
+
+/* the run is done: remove every checkpoint of it, those of other digit
+   counts or constants stay */
+void
+ckpt_clear(void)
+{
+  DIR *dir;
+  struct dirent *e;
+  ckpt_head_t h;
+  unsigned long a,b;
+  char *path;
+  FILE *f;
+  int n;
+
+  if (!ckpt_dir || !(dir = opendir(ckpt_dir)))
+    return;
+  while ((e = readdir(dir))) {
+    n = 0;
+    if (sscanf(e->d_name,"bs-%lu-%lu.ckpt%n",&a,&b,&n) < 2 || e->d_name[n])
+      continue;
+    path = ckpt_path(a,b,"");
+    if ((f = ckpt_head(path,&h))) {
+      fclose(f);
+      if (h.terms==terms)
+        unlink(path);
+    }
+    free(path);
+  }
+  closedir(dir);
+}
+
+/* r = (p,q,g) of [a,b) if a usable checkpoint of it exists, one with g
+   where the run needs g of [a,b) */
+int
+ckpt_load(unsigned long a,unsigned long b,bs_t r)
+{
+  ckpt_head_t h;
+  char *path;
+  FILE *f;
+  int ok = 0;
+
+  if (!ckpt_dir)
+    return 0;
+  path = ckpt_path(a,b,"");
+  f = ckpt_head(path,&h);
+  free(path);
+  if (f && h.terms==terms && h.a==(long)a && h.b==(long)b &&
+      (h.gflag || !BS_GFLAG(b)))
+    ok = ckpt_body(f,r);
+  else if (f)
+    fclose(f);
+  r->a = a;
+  r->b = b;
+  return ok;
+}
+
+/*
+  a new empty file next to path, <path>.XXXXXX, to write path under and
+  rename; a name of its own, so runs saving path at the same time never
+  write over each other's.  NULL if it cannot be made.
+*/
+char *
+temp_file(const char *path)
+{
+  char *tmp = malloc(strlen(path)+8);
+  int fd;
+
+  sprintf(tmp,"%s.XXXXXX",path);
+  if ((fd = mkstemp(tmp)) < 0) {
+    free(tmp);
+    return NULL;
+  }
+  fchmod(fd,0644);
+  close(fd);
+  return tmp;
+}
+
+/* save the root r of [0,r->b), g included, for --extend; 0 if it could
+   not be, with a message */
+int
+root_save(const char *path,bs_t r)
+{
+  char *tmp = temp_file(path);
+  int ok;
+
+  if (!tmp) {
+    fprintf(stderr,"%s: cannot write checkpoint '%s'\n",prog_name,path);
+    return 0;
+  }
+  ok = ckpt_write(path,tmp,r->b,0,r->b,r);
+  free(tmp);
+  return ok;
+}
+
+/* can a root be saved in path: a temporary file next to it can be made */
+int
+root_writable(const char *path)
+{
+  char *tmp = temp_file(path);
+
+  if (!tmp)
+    return 0;
+  remove(tmp);
+  free(tmp);
+  return 1;
+}
+
+/* the terms of the root saved in path, 0 if there is none, -1 if path is
+   something else, a root without g included */
+long
+root_terms(const char *path)
+{
+  ckpt_head_t h;
+  FILE *f = ckpt_head(path,&h);
+
+  if (!f)
+    return access(path,F_OK)==0 ? -1 : 0;
+  fclose(f);
+  return h.a==0 && h.b==h.terms && h.gflag ? h.b : -1;
+}
+
+/* r = the root saved in path */
+int
+root_load(const char *path,bs_t r)
+{
+  ckpt_head_t h;
+  FILE *f = ckpt_head(path,&h);
+
+  if (!f)
+    return 0;
+  if (!h.gflag) {
+    fclose(f);
+    return 0;
+  }
+  r->a = 0;
+  r->b = h.b;
+  return ckpt_body(f,r) && mpz_sgn(r->g)!=0;
+}
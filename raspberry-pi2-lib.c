@@ -0,0 +1,577 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * The part of the program that is not the command line: the globals the
+   engines share, the table of engines, the final step after the binary
+   splitting, and libchudnovsky's entry points from chudnovsky.h on top
+   of them.  main() in raspberry-pi2.c and the library run the same
+   bs_root(), final_div() and final_mul(); the library sets the globals
+   from its chud_ctx first, under a lock, since they are the state of
+   one computation.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+#include "chudnovsky.h"
+
+long terms;
+int factor = 0;
+int lowmem = 0;
+long chunks_per_thread = 1;
+int verbose = 1;
+unsigned long bs_first = 0;
+int keep_g = 0;
+const engine_t *engine;
+char *prog_name = "libchudnovsky";
+
+const engine_t *const engines[] = {
+#ifdef HAVE_OPENMP
+  &engine_nested,
+#endif
+  &engine_task,
+  &engine_forloop,
+  &engine_steal,
+#ifdef HAVE_CILK
+  &engine_cilk,
+  &engine_cilk_task,
+#endif
+#ifdef HAVE_MPI
+  &engine_mpi,
+#endif
+  NULL
+};
+
+////////////////////////////////////////////////////////////////////////////
+
+/* https://blog.habets.se/2010/09/gettimeofday-should-never-be-used-to-measure-time.html */
+
+double wall_clock()
+{
+  struct timespec timeval;
+
+  (void) clock_gettime (CLOCK_MONOTONIC, &timeval);
+  return (double) timeval.tv_sec +
+         (double) timeval.tv_nsec / 1000000000.0;
+}
+
+double cpu_time()
+{
+  struct rusage rusage;
+
+  (void) getrusage( RUSAGE_SELF, &rusage );
+  return (double)rusage.ru_utime.tv_sec +
+         (double)rusage.ru_utime.tv_usec / 1000000.0;
+}
+
+/* the factor of a phase line, 0 for one too short to time */
+double cpu_factor(double cpu,double wall)
+{
+  return wall >= 1e-3 ? cpu/wall : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+const engine_t *
+find_engine(const char *name)
+{
+  int i;
+
+  for (i=0; engines[i]; i++)
+    if (strcmp(engines[i]->name,name)==0)
+      return engines[i];
+  return NULL;
+}
+
+/* r = (p,q,g) of [0,terms), 1, 0 and 1 for no terms at all */
+void
+bs_root(bs_t r,long threads)
+{
+  if (terms<=0) {
+    mpz_set_ui(r->p,1);
+    mpz_set_ui(r->q,0);
+    mpz_set_ui(r->g,1);
+  } else {
+    engine->bs(r,threads);
+  }
+}
+
+/*
+  r = the root of [0,terms) by way of the root of [0,t1) saved in path,
+  if t1 <= terms: only [t1,terms) goes to the engine, with g kept, then
+  one more merge at the top.  The new root, g included, replaces the
+  saved one; a saved root with more terms is left alone.  Returns t1,
+  or -1 with a message if path cannot be read or written.
+*/
+long
+bs_extend(bs_t r,const char *path,long threads)
+{
+  long t1 = root_terms(path);
+  bs_t r1;
+
+  if (t1 < 0) {
+    fprintf(stderr,"%s: '%s' is not a saved root of %s%s\n",prog_name,path,
+      series->name,factor ? " with option 4" : "");
+    return -1;
+  }
+  if (terms<=0 || t1 > terms) {
+    bs_root(r,threads);
+    return 0;
+  }
+  /* the saved root is read before anything is computed on top of it */
+  if (t1) {
+    bs_init(r1);
+    if (!root_load(path,r1)) {
+      fprintf(stderr,"%s: cannot read the root in '%s'\n",prog_name,path);
+      bs_clear(r1);
+      return -1;
+    }
+    if (t1==terms) {
+      bs_swap(r,r1);
+      bs_clear(r1);
+      return t1;
+    }
+  }
+
+  bs_first = t1;
+  keep_g = 1;
+  engine->bs(r,threads);
+  keep_g = 0;
+  bs_first = 0;
+  if (t1) {
+    bs_merge(r1,r,1,threads);
+    bs_swap(r,r1);
+    bs_clear(r1);
+  }
+  r->a = 0;
+  r->b = terms;
+  return root_save(path,r) ? t1 : -1;
+}
+
+/* final step: job 0 is x = 1/q, job 1 is t = 1/sqrt(C) */
+
+typedef struct {
+  mpz_ptr x,t;
+  mpz_srcptr q;
+  long m;
+  int tds[2];
+} final_t;
+
+static void
+final_job(int i,void *arg)
+{
+  final_t *f = arg;
+
+  perf_thread();
+  if (i==0)
+    newton_inv(f->x,f->q,f->m,f->tds[0]);
+  else
+    newton_invsqrt(f->t,C,f->m,f->tds[1]);
+}
+
+/* drop all but the top n bits of a and return how many went */
+static long
+keep_bits(mpz_t a,long n)
+{
+  long s = (long)mpz_sizeinbase(a,2)-n;
+
+  if (s <= 0)
+    return 0;
+  mpz_tdiv_q_2exp(a,a,s);
+  return s;
+}
+
+/* the parts of the final step and the output that need only d */
+
+typedef struct {
+  long m,d,threads;
+  int format,file;              /* format -1 for no digits */
+} pipe_t;
+
+static pipe_t pipe_arg;
+static pthread_t pipe_thread;
+static int pipe_on,pipe_ready;
+static mpz_t pipe_sqrt;         /* 2^m/sqrt(C) */
+
+static void *
+pipe_job(void *arg)
+{
+  pipe_t *p = arg;
+
+  perf_thread();
+  if (series==&series_pi) {
+    mpz_init(pipe_sqrt);
+    newton_invsqrt(pipe_sqrt,C,p->m,1);
+    pipe_ready = 1;
+  }
+  if (p->format >= 0)
+    digits_prepare(p->format,p->file,p->d,p->threads);
+  return NULL;
+}
+
+/*
+  start t = 2^m/sqrt(C) of final_div() and digits_prepare() for d
+  digits in format, or none when format < 0, on a thread of their own
+  while the engine splits; final_div() and final_wait() wait for it
+*/
+void
+final_start(long m,int format,int file,long d,long threads)
+{
+  pipe_arg.m = m;
+  pipe_arg.d = d;
+  pipe_arg.threads = threads;
+  pipe_arg.format = format;
+  pipe_arg.file = file;
+  if (pthread_create(&pipe_thread,NULL,pipe_job,&pipe_arg)!=0) {
+    fprintf(stderr,"%s: cannot start the pipeline thread\n",prog_name);
+    exit(1);
+  }
+  pipe_on = 1;
+}
+
+void
+final_wait(void)
+{
+  if (pipe_on) {
+    pthread_join(pipe_thread,NULL);
+    pipe_on = 0;
+  }
+}
+
+/*
+  the reciprocals of the final step with m bits, from the p and q of the
+  root; returns the shift of x*t.  The one of p and q it is done with is
+  cleared.
+
+	  p*(C/D)*sqrt(C)
+    pi = -----------------
+	     (q+A*p)
+*/
+long
+final_div(bs_t root,mpz_t x,mpz_t t,long m,long threads)
+{
+  final_t fin;
+  long shift;
+
+  fin.m = m;
+  if (series!=&series_pi) {
+
+    /* value = (a0*p+q)*num / (den*p), x = 2^(bits(den*p)+m)/(den*p) */
+    mpz_addmul_ui(root->q,root->p,series->a0);
+    mpz_mul_ui(root->q,root->q,series->num);
+    mpz_mul_ui(root->p,root->p,series->den);
+    shift = (long)mpz_sizeinbase(root->p,2)+m;
+    newton_inv(x,root->p,m,threads);
+    mpz_clear(root->p);
+
+  } else {
+
+    mpz_addmul_ui(root->q,root->p,A);
+    mpz_mul_ui(root->p,root->p,C/D);
+
+    /* final step: x = 2^(bits(q)+m)/q and t = 2^m/sqrt(C) by Newton */
+    fin.x = x;
+    fin.t = t;
+    fin.q = root->q;
+    shift = (long)mpz_sizeinbase(root->q,2)+2*m;
+    final_wait();
+    if (pipe_ready && pipe_arg.m==m) {
+      /* t came with the splitting, x gets every thread */
+      mpz_swap(t,pipe_sqrt);
+      newton_inv(x,root->q,m,threads);
+    } else if (threads < 2) {
+      fin.tds[0] = fin.tds[1] = 1;
+      run_serial(2,final_job,&fin);
+    } else {
+      fin.tds[0] = threads/2;
+      fin.tds[1] = threads-threads/2;
+      engine->run(2,final_job,&fin);
+    }
+    mpz_clear(root->q);
+    if (pipe_ready) {
+      mpz_clear(pipe_sqrt);
+      pipe_ready = 0;
+    }
+
+  }
+  return shift;
+}
+
+/* the constant = x/2^shift from the reciprocals, the shift it returns;
+   the rest of the root is cleared */
+long
+final_mul(bs_t root,mpz_t x,mpz_t t,long shift,long m,long threads)
+{
+  if (series!=&series_pi) {
+
+    /* value = (a0*p+q)*num * x / 2^shift */
+    shift -= keep_bits(root->q,m+NEWTON_GUARD);
+    pmul(x,x,root->q,threads);
+    mpz_clear(root->q);
+
+  } else {
+
+    /* pi = p*(C/D) * x * C*t / 2^shift, only the top m+G bits matter */
+    shift -= keep_bits(root->p,m+NEWTON_GUARD);
+    pmul(x,root->p,x,threads);
+    mpz_clear(root->p);
+    shift -= keep_bits(x,m+NEWTON_GUARD);
+    mpz_mul_ui(t,t,C);
+    pmul(x,x,t,threads);
+
+  }
+  return shift;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+/* held by every chud_* call: the globals are the one computation there is */
+static pthread_mutex_t lib_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the engine set up last, and the split values before any ctx changed them */
+static const engine_t *lib_engine;
+static long lib_threads;
+static double lib_ratio;
+static long lib_cutoff;
+
+void
+chud_init(chud_ctx *ctx)
+{
+  ctx->threads = 1;
+  ctx->engine = NULL;
+  ctx->memory = -1;
+  ctx->spill_dir = NULL;
+  ctx->compress = 0;
+  ctx->lowmem = 0;
+  ctx->split = 0;
+  ctx->cutoff = 0;
+  ctx->tune_file = NULL;
+  ctx->extend = NULL;
+  ctx->digits = 0;
+  ctx->terms = 0;
+}
+
+/*
+  the globals of one run from ctx, with the lock held; 0 if ctx or the
+  arguments are no good.  The mpi engine needs mpirun and every rank in
+  main(), so it is not one of the library's.
+*/
+static int
+lib_setup(chud_ctx *ctx,const char *constant,long digits)
+{
+  const engine_t *e = ctx->engine ? find_engine(ctx->engine) : engines[0];
+  const series_t *s = constant ? find_series(constant) : &series_pi;
+
+  if (!e || !s || digits < 1 || ctx->threads < 1 ||
+      ctx->split < 0 || ctx->split >= 1 || ctx->cutoff < 0)
+    return 0;
+#ifdef HAVE_MPI
+  if (e==&engine_mpi)
+    return 0;
+#endif
+
+  if (!lib_ratio) {
+    lib_ratio = split_ratio;
+    lib_cutoff = split_cutoff;
+  }
+  split_ratio = lib_ratio;
+  split_cutoff = lib_cutoff;
+  tune_file = ctx->tune_file;
+  if (tune_file)
+    tune_load();
+  if (ctx->split)
+    split_ratio = ctx->split;
+  if (ctx->cutoff)
+    split_cutoff = ctx->cutoff;
+
+  engine = e;
+  series = s;
+  lowmem = ctx->lowmem;
+  factor = 0;
+  chunks_per_thread = 1;
+  verbose = 0;
+  spill_budget = ctx->memory < 0 ? -1 : ctx->memory<<20;
+  spill_dir = ctx->spill_dir ? ctx->spill_dir : ".";
+  spill_compress = ctx->compress;
+  if (ctx->extend && (root_terms(ctx->extend) < 0 || !root_writable(ctx->extend)))
+    return 0;
+  if ((e!=lib_engine || ctx->threads!=lib_threads) && e->init)
+    e->init(ctx->threads);
+  lib_engine = e;
+  lib_threads = ctx->threads;
+
+  terms = series->terms(digits);
+  ctx->digits = digits;
+  ctx->terms = terms;
+  return 1;
+}
+
+/* x = the constant * 2^*shift to digits, as main() gets it; -1 if the
+   root of ctx->extend could not be read or saved */
+static int
+lib_run(mpz_t x,long *shift,long digits,long threads,const char *extend)
+{
+  long m = (long)(digits*BITS_PER_DIGIT+16)+NEWTON_GUARD;
+  bs_t root;
+  mpz_t t;
+
+  bs_init(root);
+  if (extend && bs_extend(root,extend,threads) < 0) {
+    bs_clear(root);
+    return -1;
+  }
+  if (!extend)
+    bs_root(root,threads);
+  mpz_clear(root->g);
+  fac_clear(root->fp);
+  fac_clear(root->fg);
+
+  mpz_init(t);
+  *shift = final_div(root,x,t,m,threads);
+  *shift = final_mul(root,x,t,*shift,m,threads);
+  mpz_clear(t);
+  return 0;
+}
+
+int
+chud_compute(chud_ctx *ctx,const char *constant,long digits,mpf_t out)
+{
+  long shift;
+  int r;
+  mpz_t x;
+
+  pthread_mutex_lock(&lib_lock);
+  if (!lib_setup(ctx,constant,digits)) {
+    pthread_mutex_unlock(&lib_lock);
+    return -1;
+  }
+  mpz_init(x);
+  r = lib_run(x,&shift,digits,ctx->threads,ctx->extend);
+  if (r==0) {
+    mpf_set_prec(out,(mp_bitcnt_t)(digits*BITS_PER_DIGIT+16));
+    mpf_set_z(out,x);
+    mpf_div_2exp(out,out,shift);
+  }
+  mpz_clear(x);
+  pthread_mutex_unlock(&lib_lock);
+  return r;
+}
+
+int
+chud_compute_pi(chud_ctx *ctx,long digits,mpf_t out)
+{
+  return chud_compute(ctx,NULL,digits,out);
+}
+
+int
+chud_digits(chud_ctx *ctx,const char *constant,long digits,
+            chud_digits_fn fn,void *arg)
+{
+  long shift;
+  int r;
+  mpz_t x;
+
+  pthread_mutex_lock(&lib_lock);
+  if (!lib_setup(ctx,constant,digits)) {
+    pthread_mutex_unlock(&lib_lock);
+    return -1;
+  }
+  mpz_init(x);
+  r = lib_run(x,&shift,digits,ctx->threads,ctx->extend);
+  if (r==0)
+    r = digits_stream(x,shift,digits,CHUD_BLOCK,fn,arg,ctx->threads);
+  mpz_clear(x);
+  pthread_mutex_unlock(&lib_lock);
+  return r;
+}
+
+/* the digits of one batch job go to the caller's fn */
+typedef struct {
+  chud_batch_fn fn;
+  void *arg;
+  long threads;
+  const batch_job_t *jobs;
+  int job;
+} lib_batch_t;
+
+static int
+lib_piece(const char *buf,size_t n,void *arg)
+{
+  lib_batch_t *b = arg;
+
+  return b->fn(b->job,buf,n,b->arg);
+}
+
+static int
+lib_done(int i,mpz_t x,long shift,long reused,void *arg)
+{
+  lib_batch_t *b = arg;
+  int r;
+
+  (void)reused;
+  b->job = i;
+  r = digits_stream(x,shift,b->jobs[i].digits,CHUD_BLOCK,lib_piece,b,b->threads);
+  return r ? r : b->fn(i,NULL,0,b->arg);
+}
+
+int
+chud_batch(chud_ctx *ctx,const chud_job *jobs,int n,
+           chud_batch_fn fn,void *arg)
+{
+  batch_job_t *bj = malloc((n > 0 ? n : 1)*sizeof(*bj));
+  lib_batch_t b;
+  int i,r = 0;
+
+  if (!bj)
+    return -1;
+  for (i=0; i<n && r==0; i++) {
+    bj[i].series = jobs[i].constant ? find_series(jobs[i].constant) : &series_pi;
+    bj[i].digits = jobs[i].digits;
+    if (!bj[i].series || bj[i].digits < 1)
+      r = -1;
+  }
+  pthread_mutex_lock(&lib_lock);
+  if (r || n < 0 || !lib_setup(ctx,NULL,1)) {
+    pthread_mutex_unlock(&lib_lock);
+    free(bj);
+    return -1;
+  }
+  b.fn = fn;
+  b.arg = arg;
+  b.threads = ctx->threads;
+  b.jobs = bj;
+  b.job = -1;
+  r = batch_run(bj,n,ctx->threads,lib_done,&b);
+  /* the last job that was done, if any */
+  if (b.job >= 0) {
+    ctx->digits = bj[b.job].digits;
+    ctx->terms = terms;
+  }
+  pthread_mutex_unlock(&lib_lock);
+  free(bj);
+  return r;
+}
@@ -0,0 +1,415 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * The "mpi" engine: one chunk of the terms per rank, built with make
+   MPICC=mpicc and run under mpirun.  Every rank computes its chunk
+   with OpenMP tasks on <threads> local threads, like the task engine.
+   The chunk results are then merged up a binomial tree.  At step k, a
+   rank with rank%(2k)==0 takes the result of rank+k.
+
+   An operand goes over as its signed size, then its limbs in pieces of
+   MPI_CHUNK bytes, with non-blocking sends and receives.  A sending rank
+   puts out p, q and g of its last merge one by one, as each product is
+   done.  The receiving rank starts on p1*p2 and q1*p2 as soon as p2 is
+   in, while q2 and g2 are still on the way.  Only rank 0 returns from
+   the engine, the others exit once their sends are through.
+
+   To run:
+   mpirun -n 4 ./raspberry-pi2 --engine=mpi 1000000 0 2
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <gmp.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "raspberry-pi2.h"
+
+#define MPI_CHUNK  (1L<<22)     /* bytes per message of a limb buffer */
+#define TAG_SIZE   1            /* +0,1,2 for p,q,g: the signed size */
+#define TAG_DATA   4            /* +0,1,2: the limbs, MPI_CHUNK at a time */
+
+/* the messages of one operand on the way */
+typedef struct {
+  MPI_Request head;             /* the signed size */
+  MPI_Request *req;             /* the pieces of the limbs */
+  long limbs;
+  int n,posted;
+} xfer_t;
+
+static long nthreads;
+static int rank,ranks;
+static unsigned long chunk;
+
+static void
+release(mpz_t x)
+{
+  mpz_clear(x);
+  mpz_init(x);
+}
+
+/* first term of the chunk of rank i */
+static unsigned long
+edge(int i)
+{
+  return i >= ranks ? (unsigned long)terms : bs_first+i*chunk;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+/* binary splitting of one chunk, the same as the task engine */
+static void
+bs(unsigned long a,unsigned long b,unsigned long level,bs_t r1)
+{
+  unsigned long mid;
+  bs_t r2;
+
+  if (b-a <= LEAF_TERMS) {
+
+    bs_block(a,b,r1);
+
+  } else {
+
+    bs_init(r2);
+
+    if (b-a==2) {
+      bs_leaf(b-1,r1);
+      bs_leaf(b,r2);
+    } else {
+
+      mid = bs_split(a,b);
+
+#ifdef _OPENMP
+      #pragma omp task firstprivate(mid,a) shared(r1)
+      {
+         bs(a,mid,level+1,r1);
+         bs_spill(r1);
+      }
+      bs(mid,b,level+1,r2);
+      #pragma omp taskwait
+#else
+      bs(a,mid,level+1,r1);
+      bs_spill(r1);
+      bs(mid,b,level+1,r2);
+#endif
+
+    }
+
+    bs_merge(r1,r2,BS_GFLAG(b),BS_TDS(nthreads,level));
+    bs_clear(r2);
+  }
+}
+
+static void
+chunk_bs(unsigned long a,unsigned long b,bs_t r)
+{
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(nthreads)
+    #pragma omp single nowait
+      bs(a,b,1,r);
+#else
+  bs(a,b,1,r);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+static void
+send_start(xfer_t *x,mpz_srcptr z,int dst,int item)
+{
+  const char *l = (const char *)mpz_limbs_read(z);
+  size_t bytes = mpz_size(z)*sizeof(mp_limb_t),off;
+  int i;
+
+  x->limbs = mpz_sgn(z) < 0 ? -(long)mpz_size(z) : (long)mpz_size(z);
+  MPI_Isend(&x->limbs,1,MPI_LONG,dst,TAG_SIZE+item,MPI_COMM_WORLD,&x->head);
+  x->n = (bytes+MPI_CHUNK-1)/MPI_CHUNK;
+  x->req = malloc(sizeof(MPI_Request)*(x->n ? x->n : 1));
+  for (i=0,off=0; i<x->n; i++,off+=MPI_CHUNK)
+    MPI_Isend(l+off,bytes-off < MPI_CHUNK ? bytes-off : MPI_CHUNK,MPI_BYTE,
+              dst,TAG_DATA+item,MPI_COMM_WORLD,&x->req[i]);
+  x->posted = 1;
+}
+
+static void
+send_wait(xfer_t *x)
+{
+  MPI_Wait(&x->head,MPI_STATUS_IGNORE);
+  MPI_Waitall(x->n,x->req,MPI_STATUSES_IGNORE);
+  free(x->req);
+}
+
+/* post the receives of the limbs once the size is known */
+static void
+recv_post(xfer_t *x,mpz_ptr z,int src,int item)
+{
+  size_t bytes = labs(x->limbs)*sizeof(mp_limb_t),off;
+  char *l;
+  int i;
+
+  x->n = (bytes+MPI_CHUNK-1)/MPI_CHUNK;
+  x->req = malloc(sizeof(MPI_Request)*(x->n ? x->n : 1));
+  l = x->n ? (char *)mpz_limbs_write(z,labs(x->limbs)) : NULL;
+  for (i=0,off=0; i<x->n; i++,off+=MPI_CHUNK)
+    MPI_Irecv(l+off,bytes-off < MPI_CHUNK ? bytes-off : MPI_CHUNK,MPI_BYTE,
+              src,TAG_DATA+item,MPI_COMM_WORLD,&x->req[i]);
+  x->posted = 1;
+}
+
+/* keep the receives of items first..n-1 moving between two products */
+static void
+recv_poll(xfer_t *x,mpz_ptr *z,int src,int first,int n)
+{
+  int i,flag;
+
+  for (i=first; i<n; i++) {
+    if (!x[i].posted) {
+      MPI_Test(&x[i].head,&flag,MPI_STATUS_IGNORE);
+      if (flag)
+        recv_post(&x[i],z[i],src,i);
+    } else if (x[i].n) {
+      MPI_Testall(x[i].n,x[i].req,&flag,MPI_STATUSES_IGNORE);
+    }
+  }
+}
+
+static void
+recv_wait(xfer_t *x,mpz_ptr z,int src,int item)
+{
+  if (!x->posted) {
+    MPI_Wait(&x->head,MPI_STATUS_IGNORE);
+    recv_post(x,z,src,item);
+  }
+  MPI_Waitall(x->n,x->req,MPI_STATUSES_IGNORE);
+  free(x->req);
+  if (x->n)
+    mpz_limbs_finish(z,x->limbs);
+  else
+    mpz_set_ui(z,0);
+}
+
+/*
+  r1 = r1 merged with r2, where r2 comes from rank src when src >= 0,
+  and the result goes to rank dst when dst >= 0.  The products are in
+  the order the operands come in and the result goes out.  Results that
+  hop between ranks carry no factored forms, so the common factor
+  removal is only done with local operands.
+*/
+static void
+xmerge(bs_t r1,bs_t r2,int src,int dst,int gflag)
+{
+  xfer_t in[3],out[3];
+  mpz_ptr z2[3];
+  int i,n = gflag ? 3 : 2;
+
+  z2[0] = r2->p;
+  z2[1] = r2->q;
+  z2[2] = r2->g;
+  if (src >= 0) {
+    for (i=0; i<n; i++) {
+      MPI_Irecv(&in[i].limbs,1,MPI_LONG,src,TAG_SIZE+i,MPI_COMM_WORLD,&in[i].head);
+      in[i].posted = 0;
+    }
+    recv_wait(&in[0],r2->p,src,0);
+  } else {
+    if (factor)
+      fac_remove_gcd(r2->p,r2->fp,r1->g,r1->fg);
+  }
+
+  pmul(r1->p,r1->p,r2->p,nthreads);
+  if (dst >= 0)
+    send_start(&out[0],r1->p,dst,0);
+  if (src >= 0)
+    recv_poll(in,z2,src,1,n);
+
+  pmul(r1->q,r1->q,r2->p,nthreads);
+  release(r2->p);
+  if (src >= 0)
+    recv_wait(&in[1],r2->q,src,1);
+  pmul(r2->q,r2->q,r1->g,nthreads);
+  mpz_add(r1->q,r1->q,r2->q);
+  release(r2->q);
+  if (dst >= 0)
+    send_start(&out[1],r1->q,dst,1);
+
+  if (gflag) {
+    if (src >= 0)
+      recv_wait(&in[2],r2->g,src,2);
+    pmul(r1->g,r1->g,r2->g,nthreads);
+    if (dst >= 0)
+      send_start(&out[2],r1->g,dst,2);
+  } else {
+    release(r1->g);
+  }
+  release(r2->g);
+
+  if (dst >= 0)
+    for (i=0; i<n; i++)
+      send_wait(&out[i]);
+}
+
+/* r goes to rank dst as it is */
+static void
+xsend(bs_t r,int dst,int gflag)
+{
+  xfer_t out[3];
+  int i,n = gflag ? 3 : 2;
+
+  send_start(&out[0],r->p,dst,0);
+  send_start(&out[1],r->q,dst,1);
+  if (gflag)
+    send_start(&out[2],r->g,dst,2);
+  for (i=0; i<n; i++)
+    send_wait(&out[i]);
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+static void
+mpi_finalize(void)
+{
+  MPI_Finalize();
+}
+
+static void
+mpi_init(long threads)
+{
+  int provided;
+
+  nthreads = threads;
+  MPI_Init_thread(NULL,NULL,MPI_THREAD_FUNNELED,&provided);
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&ranks);
+  atexit(mpi_finalize);
+  /* the digits only ever come from rank 0 */
+  if (rank != 0)
+    freopen("/dev/null","w",stdout);
+}
+
+/* this process's rank, 0 before mpi_init */
+int
+mpi_rank(void)
+{
+  return rank;
+}
+
+/* every rank takes the split ratio and cutoff rank 0 loaded or tuned */
+void
+mpi_share_tune(void)
+{
+  MPI_Bcast(&split_ratio,1,MPI_DOUBLE,0,MPI_COMM_WORLD);
+  MPI_Bcast(&split_cutoff,1,MPI_LONG,0,MPI_COMM_WORLD);
+}
+
+static void
+mpi_bs(bs_t r,long threads)
+{
+  unsigned long a,b,mid;
+  long k,last;
+  int dst;
+  double begin,mid0,mid1;
+  double wbegin,wmid0,wmid1;
+  bs_t r2;
+
+  if (terms-(long)bs_first < ranks) {
+    if (rank==0)
+      fprintf(stderr,"%s: %d ranks for %ld terms, use fewer ranks\n",
+        prog_name,ranks,terms-(long)bs_first);
+    exit(1);
+  }
+  chunk = (terms-bs_first)/ranks;
+  a = edge(rank);
+  b = edge(rank+1);
+
+  /* the step this rank sends at, and the last step it takes a result at */
+  dst = -1;
+  last = 0;
+  for (k = 1; k < ranks; k *= 2) {
+    if (rank%(2*k)) {
+      dst = rank-k;
+      break;
+    }
+    if (rank+k < ranks)
+      last = k;
+  }
+
+  begin = cpu_time();
+  wbegin = wall_clock();
+
+  bs_init(r2);
+  if (dst >= 0 && last==0) {
+    /* a leaf of the tree: its own root merge already feeds the send */
+    if (b-a > 1) {
+      mid = bs_split(a,b);
+      chunk_bs(a,mid,r);
+      chunk_bs(mid,b,r2);
+      xmerge(r,r2,-1,dst,BS_GFLAG(b));
+    } else {
+      chunk_bs(a,b,r);
+      xsend(r,dst,BS_GFLAG(b));
+    }
+    bs_clear(r2);
+    bs_clear(r);
+    exit(0);
+  }
+  chunk_bs(a,b,r);
+
+  mid0 = cpu_time();
+  wmid0 = wall_clock();
+  if (rank==0)
+    fprintf(stderr,"bs1        cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+      mid0-begin,wmid0-wbegin,cpu_factor(mid0-begin,wmid0-wbegin));
+
+  for (k = 1; k <= last; k *= 2) {
+    if (rank+k < ranks) {
+      b = edge(rank+2*k);
+      xmerge(r,r2,rank+k,k==last ? dst : -1,BS_GFLAG(b));
+    }
+  }
+  bs_clear(r2);
+  if (dst >= 0) {
+    bs_clear(r);
+    exit(0);
+  }
+
+  mid1 = cpu_time();
+  wmid1 = wall_clock();
+  fprintf(stderr,"bs2        cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+}
+
+static void
+mpi_run(int n,void (*job)(int,void *),void *arg)
+{
+  int i;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(n)
+#endif
+  for (i = 0; i < n; i++)
+    job(i, arg);
+}
+
+const engine_t engine_mpi = {
+  "mpi",mpi_init,mpi_bs,mpi_run
+};
@@ -0,0 +1,135 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Parallel multiplication of the big operands near the root of the
+   splitting tree.  mpz_mul is single threaded, so above PMUL_LIMBS the
+   operands are split in halves and the three Karatsuba products
+
+     z0 = a0*b0,  z2 = a1*b1,  z1 = (a0+a1)*(b0+b1) - z0 - z2
+
+   are run through the engine's run() hook, each with a third of the
+   workers, recursively.  Very unbalanced operands are cut only on the long
+   side, which gives two independent products instead of three.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+long pmul_limbs = PMUL_LIMBS;
+
+typedef struct {
+  mpz_ptr r[3];
+  mpz_srcptr a[3],b[3];
+  int tds[3];
+  int level;                    /* of the caller, for --perf */
+} pmul_t;
+
+static void
+pmul_job(int i,void *arg)
+{
+  pmul_t *m = arg;
+  int old = perf_enter(m->level);
+
+  pmul(m->r[i],m->a[i],m->b[i],m->tds[i]);
+  perf_leave(old);
+}
+
+/* r = a*b using up to tds workers; r may be the same as a or b */
+void
+pmul(mpz_ptr r,mpz_srcptr a,mpz_srcptr b,int tds)
+{
+  mp_size_t an,bn,h;
+  mp_bitcnt_t shift;
+  mpz_srcptr t;
+  mpz_t a0,a1,b0,b1,s0,s1,z0,z1,z2;
+  pmul_t m;
+  int neg;
+
+  an = mpz_size(a);
+  bn = mpz_size(b);
+  if (an < bn) {
+    t = a; a = b; b = t;
+    h = an; an = bn; bn = h;
+  }
+  if (tds < 2 || an < pmul_limbs || bn==0) {
+    mpz_mul(r,a,b);
+    return;
+  }
+
+  neg = (mpz_sgn(a) < 0) != (mpz_sgn(b) < 0);
+  m.level = perf_level();
+  h = (an+1)/2;
+  shift = (mp_bitcnt_t)h*GMP_NUMB_BITS;
+  mpz_roinit_n(a0,mpz_limbs_read(a),h);
+  mpz_roinit_n(a1,mpz_limbs_read(a)+h,an-h);
+
+  if (bn <= h) {
+
+    /* b is no longer than half of a: (a1*2^s + a0)*b */
+    mpz_roinit_n(b0,mpz_limbs_read(b),bn);
+    mpz_init(z0);
+    mpz_init(z2);
+    m.r[0] = z0; m.a[0] = a0; m.b[0] = b0; m.tds[0] = tds/2;
+    m.r[1] = z2; m.a[1] = a1; m.b[1] = b0; m.tds[1] = tds-tds/2;
+    engine->run(2,pmul_job,&m);
+    mpz_mul_2exp(r,z2,shift);
+    mpz_add(r,r,z0);
+    mpz_clear(z0);
+    mpz_clear(z2);
+
+  } else if (tds < 3) {
+
+    mpz_mul(r,a,b);
+    return;
+
+  } else {
+
+    mpz_roinit_n(b0,mpz_limbs_read(b),h);
+    mpz_roinit_n(b1,mpz_limbs_read(b)+h,bn-h);
+    mpz_init(s0);
+    mpz_init(s1);
+    mpz_add(s0,a0,a1);
+    mpz_add(s1,b0,b1);
+    mpz_init(z0);
+    mpz_init(z1);
+    mpz_init(z2);
+    m.r[0] = z0; m.a[0] = a0; m.b[0] = b0; m.tds[0] = tds/3;
+    m.r[1] = z2; m.a[1] = a1; m.b[1] = b1; m.tds[1] = tds/3;
+    m.r[2] = z1; m.a[2] = s0; m.b[2] = s1; m.tds[2] = tds-2*(tds/3);
+    engine->run(3,pmul_job,&m);
+    mpz_clear(s0);
+    mpz_clear(s1);
+
+    mpz_sub(z1,z1,z0);
+    mpz_sub(z1,z1,z2);
+    mpz_mul_2exp(r,z2,2*shift);
+    mpz_mul_2exp(z1,z1,shift);
+    mpz_add(r,r,z1);
+    mpz_add(r,r,z0);
+    mpz_clear(z0);
+    mpz_clear(z1);
+    mpz_clear(z2);
+
+  }
+
+  if (neg)
+    mpz_neg(r,r);
+}
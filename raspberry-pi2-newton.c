@@ -0,0 +1,126 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Reciprocal and inverse square root by Newton iteration, for the final
+   step pi = p*(C/D)*sqrt(C)/(q+A*p).  Everything is kept in fixed point
+   mpz, the working precision doubles at each step and every product goes
+   through pmul, so the whole step spreads over the workers instead of
+   running one mpf_div and one mpf_sqrt_ui on two threads.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define NEWTON_BASE   (1L<<15)  /* bits, below this GMP divides directly */
+#define NEWTON_STEP   8         /* extra bits carried into each doubling */
+
+/* r = the top n bits of a, i.e. a*2^(n-bits(a)) rounded down */
+static void
+top_bits(mpz_t r,mpz_srcptr a,long n)
+{
+  long ab = mpz_sizeinbase(a,2);
+
+  if (ab > n)
+    mpz_tdiv_q_2exp(r,a,ab-n);
+  else
+    mpz_mul_2exp(r,a,n-ab);
+}
+
+/*
+  x = 2^(bits(q)+m)/q to about m bits, q > 0.
+
+  With Q = q/2^bits(q) in [1/2,1) and X = x/2^m, one step from h to m bits
+  is X' = X + X*(1-Q*X).  Only the top m+G bits of q take part in it.
+*/
+void
+newton_inv(mpz_t x,mpz_srcptr q,long m,int tds)
+{
+  long h;
+  mpz_t qt,e;
+
+  mpz_init(qt);
+  mpz_init(e);
+  top_bits(qt,q,m+NEWTON_GUARD);
+
+  if (m <= NEWTON_BASE) {
+    mpz_set_ui(e,1);
+    mpz_mul_2exp(e,e,2*m+NEWTON_GUARD);
+    mpz_tdiv_q(x,e,qt);
+  } else {
+    h = m/2+NEWTON_STEP;
+    newton_inv(x,q,h,tds);
+
+    /* e = 2^(m+G+h)*(1-Q*X), about m+G bits of which the top h+G count */
+    pmul(e,qt,x,tds);
+    mpz_clear(qt);
+    mpz_init_set_ui(qt,1);
+    mpz_mul_2exp(qt,qt,m+NEWTON_GUARD+h);
+    mpz_sub(e,qt,e);
+    mpz_fdiv_q_2exp(e,e,m-h);
+
+    pmul(e,x,e,tds);
+    mpz_fdiv_q_2exp(e,e,3*h+NEWTON_GUARD-m);
+    mpz_mul_2exp(x,x,m-h);
+    mpz_add(x,x,e);
+  }
+
+  mpz_clear(qt);
+  mpz_clear(e);
+}
+
+/*
+  t = 2^m/sqrt(c) to about m bits.
+
+  With T = t/2^m one step is T' = T + T*(1-c*T^2)/2.
+*/
+void
+newton_invsqrt(mpz_t t,unsigned long c,long m,int tds)
+{
+  long h;
+  mpz_t e,f;
+
+  mpz_init(e);
+
+  if (m <= NEWTON_BASE) {
+    mpz_set_ui(e,1);
+    mpz_mul_2exp(e,e,2*m);
+    mpz_tdiv_q_ui(e,e,c);
+    mpz_sqrt(t,e);
+  } else {
+    h = m/2+NEWTON_STEP+16;   /* 1/sqrt(C) starts with about 10 zero bits */
+    newton_invsqrt(t,c,h,tds);
+
+    /* e = 2^(2h)*(1-c*T^2) */
+    pmul(e,t,t,tds);
+    mpz_mul_ui(e,e,c);
+    mpz_init_set_ui(f,1);
+    mpz_mul_2exp(f,f,2*h);
+    mpz_sub(e,f,e);
+    mpz_clear(f);
+
+    pmul(e,t,e,tds);
+    mpz_fdiv_q_2exp(e,e,3*h+1-m);
+    mpz_mul_2exp(t,t,m-h);
+    mpz_add(t,t,e);
+  }
+
+  mpz_clear(e);
+}
@@ -0,0 +1,139 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Placement on NUMA hosts, on with --numa.  The nodes with cpus are
+   read from NUMA_SYSFS at the start.  The nested engine hands every
+   half of the tree half of the nodes, along with half of the threads,
+   until a subtree has one node; the thread that runs the subtree binds
+   itself to the cpus of that node, and the threads its products start
+   come from it.  The top log2(nodes) levels are the only ones whose
+   merges read operands made on other nodes.
+
+   The large blocks of the pool allocator, the operands from a few
+   thousand terms up, are bound to the node of the thread that maps
+   them before the first touch, so the pages of a subtree stay on its
+   node even when another thread of the product writes them first.
+   Smaller blocks come from the per-thread arenas and are placed by the
+   first touch of their own, pinned, thread.
+
+   Nothing here needs libnuma: the cpu lists come from sysfs and the
+   bind is the mbind system call, skipped where the system lacks it.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#ifndef NUMA_SYSFS
+#define NUMA_SYSFS    "/sys/devices/system/node"
+#endif
+#define NUMA_MAX      64        /* node ids looked at, one word of mask */
+#define NUMA_PREFERRED 1        /* MPOL_PREFERRED of <linux/mempolicy.h> */
+
+int numa_nodes = 0;
+
+static int node_id[NUMA_MAX];
+static cpu_set_t node_cpus[NUMA_MAX];
+
+/* the node range the thread is bound to, [0,0) for none */
+static __thread int bound0,bound1;
+
+/* cpus of a list like "0-3,8-11" into s; 0 if there are none */
+static int
+parse_cpus(FILE *f,cpu_set_t *s)
+{
+  int lo,hi,c,n = 0;
+
+  CPU_ZERO(s);
+  while (fscanf(f,"%d",&lo)==1) {
+    hi = lo;
+    if ((c = getc(f))=='-') {
+      if (fscanf(f,"%d",&hi)!=1)
+        break;
+      c = getc(f);
+    }
+    for (; lo<=hi && lo<CPU_SETSIZE; lo++, n++)
+      CPU_SET(lo,s);
+    if (c!=',')
+      break;
+  }
+  return n;
+}
+
+/* the nodes with cpus, how many there are */
+int
+numa_start(void)
+{
+  char path[sizeof(NUMA_SYSFS)+32];
+  FILE *f;
+  int i;
+
+  numa_nodes = 0;
+  for (i=0; i<NUMA_MAX; i++) {
+    sprintf(path,"%s/node%d/cpulist",NUMA_SYSFS,i);
+    if (!(f = fopen(path,"r")))
+      continue;
+    if (parse_cpus(f,&node_cpus[numa_nodes]))
+      node_id[numa_nodes++] = i;
+    fclose(f);
+  }
+  return numa_nodes;
+}
+
+/* run the calling thread on the cpus of nodes [n0,n1) */
+void
+numa_bind(int n0,int n1)
+{
+  cpu_set_t s;
+  int i;
+
+  if (numa_nodes < 2 || (n0==bound0 && n1==bound1))
+    return;
+  CPU_ZERO(&s);
+  for (i=n0; i<n1; i++)
+    CPU_OR(&s,&s,&node_cpus[i]);
+  if (sched_setaffinity(0,sizeof(s),&s)==0) {
+    bound0 = n0;
+    bound1 = n1;
+  }
+}
+
+/* keep the pages of a new mapping on the node of the calling thread */
+void
+numa_place(void *p,size_t len)
+{
+#ifdef SYS_mbind
+  unsigned long mask;
+
+  if (numa_nodes < 2 || bound1-bound0!=1)
+    return;
+  mask = 1UL<<node_id[bound0];
+  (void) syscall(SYS_mbind,p,len,NUMA_PREFERRED,&mask,NUMA_MAX+1,0);
+#else
+  (void)p;
+  (void)len;
+#endif
+}
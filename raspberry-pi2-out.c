@@ -0,0 +1,556 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Decimal output.  An integer of len digits is cut as n = hi*10^k + lo with
+   k = RADIX_DIGITS*2^i the largest table power below len, and both halves
+   are converted on their own, in parallel through the engine's run() hook,
+   straight into their slot of a preallocated buffer.  The divisions by
+   10^k use a Newton reciprocal and pmul, so they are not serial either;
+   a subtree left with one worker goes to mpz_get_str.
+
+ * The digits go to a malloc'ed buffer for stdout, or to a file mapped
+   with mmap.  For a file the conversion is cut into OUT_BLOCK sized
+   pieces, and each piece is handed to the kernel for writeback and
+   dropped from memory as soon as it is done.  Only a few blocks of the
+   decimal string are resident at any time.  A file holds either the
+   text that goes to stdout, or the digits after the 3 packed 19 to a
+   little endian 64-bit word behind a PACK_HEADER byte text header.
+
+ * For the library, digits_stream() converts into a buffer the same way
+   and hands the digits on in order as soon as every piece in front of
+   them is done: the finished pieces are kept as sorted spans, and the
+   ones that meet the digits already sent go out.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define RADIX_LEVELS  64
+#define OUT_BLOCK     (1L<<24)  /* bytes of a file converted at once */
+
+/* radix_pow[i] = 10^(unit*base*2^i), radix_inv[i] its reciprocal or 0 */
+static mpz_t  radix_pow[RADIX_LEVELS],radix_inv[RADIX_LEVELS];
+static int    levels;
+static int    unit;             /* digits per output unit */
+static int    bytes;            /* bytes per output unit */
+static size_t base;             /* units of the smallest table power */
+static size_t block;            /* most units one worker converts at once */
+static void (*done)(char *p,size_t n);
+static int    table_unit;       /* the unit of the table built */
+
+/* 10^frac ahead of digits_write(), frac -1 for none */
+static mpz_t  pre_scale;
+static long   pre_frac = -1;
+
+/* the file being written, for done() */
+static int    out_fd = -1;
+static char  *out_map;
+
+/* r = 10^e using up to tds workers */
+void
+radix_pow10(mpz_t r,unsigned long e,int tds)
+{
+  if (e <= RADIX_DIGITS) {
+    mpz_ui_pow_ui(r,10,e);
+    return;
+  }
+  radix_pow10(r,e/2,tds);
+  pmul(r,r,r,tds);
+  if (e&1)
+    mpz_mul_ui(r,r,10);
+}
+
+/*
+  q = n/P, n = n%P for P = radix_pow[i] using its reciprocal 2^(pb+m)/P,
+  m = pb+G, pb = bits(P).  n < P^2, so only the top pb+G bits of n count
+  and the estimate is off by a few units at most.
+*/
+static void
+div_pow(mpz_t q,mpz_t n,int i,int tds)
+{
+  long pb = mpz_sizeinbase(radix_pow[i],2),s;
+  mpz_t t;
+
+  mpz_init(t);
+  s = pb-NEWTON_GUARD;
+  mpz_tdiv_q_2exp(t,n,s);
+  pmul(q,t,radix_inv[i],tds);
+  mpz_tdiv_q_2exp(q,q,2*pb+NEWTON_GUARD-s);
+
+  pmul(t,q,radix_pow[i],tds);
+  mpz_sub(n,n,t);
+  while (mpz_sgn(n) < 0) {
+    mpz_sub_ui(q,q,1);
+    mpz_add(n,n,radix_pow[i]);
+  }
+  while (mpz_cmp(n,radix_pow[i]) >= 0) {
+    mpz_add_ui(q,q,1);
+    mpz_sub(n,n,radix_pow[i]);
+  }
+  mpz_clear(t);
+}
+
+/* buf = the len units of n < 10^(len*unit), by GMP's own conversion */
+static void
+leaf(char *buf,mpz_srcptr n,size_t len)
+{
+  size_t digits = len*unit,m,i;
+  char *tmp,*s;
+  uint64_t w;
+  int j;
+
+  tmp = malloc(digits+2);
+  mpz_get_str(tmp,10,n);
+  m = strlen(tmp);
+
+  if (unit==1) {
+    memset(buf,'0',digits-m);
+    memcpy(buf+digits-m,tmp,m);
+  } else {
+    memmove(tmp+digits-m,tmp,m);
+    memset(tmp,'0',digits-m);
+    for (i=0; i<len; i++) {
+      s = tmp+i*unit;
+      for (w=0, j=0; j<unit; j++)
+        w = 10*w+(s[j]-'0');
+      for (j=0; j<8; j++)
+        buf[8*i+j] = (char)(w>>(8*j));
+    }
+  }
+  free(tmp);
+
+  if (done)
+    done(buf,len*bytes);
+}
+
+typedef struct {
+  char *buf[2];
+  mpz_ptr n[2];
+  size_t len[2];
+  int tds[2];
+} conv_t;
+
+static void conv(char *buf,mpz_ptr n,size_t len,int tds);
+
+static void
+conv_job(int i,void *arg)
+{
+  conv_t *c = arg;
+
+  perf_thread();
+  conv(c->buf[i],c->n[i],c->len[i],c->tds[i]);
+}
+
+/* buf = the len units of n < 10^(len*unit), leading zeros kept; n is used up */
+static void
+conv(char *buf,mpz_ptr n,size_t len,int tds)
+{
+  size_t k;
+  int i;
+  mpz_t hi;
+  conv_t c;
+
+  if (len <= base || (tds < 2 && len <= block)) {
+    leaf(buf,n,len);
+    return;
+  }
+
+  for (i=0, k=base; 2*k < len; i++)
+    k *= 2;
+
+  mpz_init(hi);
+  if (mpz_size(radix_inv[i]))
+    div_pow(hi,n,i,tds);
+  else
+    mpz_tdiv_qr(hi,n,n,radix_pow[i]);
+
+  c.buf[0] = buf;             c.n[0] = hi; c.len[0] = len-k; c.tds[0] = tds/2;
+  c.buf[1] = buf+(len-k)*bytes; c.n[1] = n; c.len[1] = k;    c.tds[1] = tds-tds/2;
+  if (tds < 2)
+    run_serial(2,conv_job,&c);
+  else
+    engine->run(2,conv_job,&c);
+  mpz_clear(hi);
+}
+
+/* unit, bytes and base of the given output format */
+static void
+set_format(int format)
+{
+  unit  = format==OUT_PACKED ? PACK_DIGITS : 1;
+  bytes = format==OUT_PACKED ? 8 : 1;
+  base  = (RADIX_DIGITS+unit-1)/unit;
+}
+
+static void
+table_clear(void)
+{
+  int i;
+
+  for (i=0; i<levels; i++) {
+    mpz_clear(radix_pow[i]);
+    mpz_clear(radix_inv[i]);
+  }
+  levels = 0;
+}
+
+/*
+  the powers below len units, and the reciprocals of the levels that
+  threads workers split; every product runs on tds of them
+*/
+static void
+table_build(size_t len,long threads,int tds)
+{
+  long t;
+  int i,top;
+
+  table_unit = unit;
+  mpz_init(radix_pow[0]);
+  mpz_ui_pow_ui(radix_pow[0],10,unit*base);
+  for (levels=1; (base<<levels) < len; levels++) {
+    mpz_init(radix_pow[levels]);
+    pmul(radix_pow[levels],radix_pow[levels-1],radix_pow[levels-1],tds);
+  }
+
+  /* the levels split with two or more workers get a reciprocal */
+  for (t=threads, top=levels; t >= 2 && top > 0; t /= 2)
+    top--;
+  for (i=0; i<levels; i++) {
+    mpz_init(radix_inv[i]);
+    if (i >= top)
+      newton_inv(radix_inv[i],radix_pow[i],
+                 mpz_sizeinbase(radix_pow[i],2)+NEWTON_GUARD,tds);
+  }
+}
+
+/*
+  build the powers (and reciprocals) radix_convert(..,len,format,blk,..,
+  threads) would, ahead of it and on one worker, e.g. next to the binary
+  splitting with --pipeline; the next conversion keeps them if they are
+  of its format and cover its len units, else it builds its own
+*/
+void
+radix_prepare(size_t len,int format,size_t blk,long threads)
+{
+  table_clear();
+  set_format(format);
+  if (len > base && (threads >= 2 || len > blk))
+    table_build(len,threads,1);
+}
+
+/*
+  buf = n < 10^(len*unit) in len units of the given format, leading zeros
+  kept, using up to threads workers.  No worker converts more than blk
+  units in one go, and done() is called for each finished piece.  n is
+  destroyed.
+*/
+void
+radix_convert(char *buf,mpz_t n,size_t len,int format,size_t blk,
+              void (*done_fn)(char *,size_t),long threads)
+{
+  set_format(format);
+  block = blk;
+  done  = done_fn;
+
+  if (len <= base || (threads < 2 && len <= block)) {
+    table_clear();
+    leaf(buf,n,len);
+    return;
+  }
+
+  if (table_unit!=unit || (base<<levels) < len) {
+    table_clear();
+    table_build(len,threads,threads);
+  }
+  conv(buf,n,len,threads);
+  table_clear();
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+/* start writeback of the whole pages of a finished block, then drop them */
+static void
+out_done(char *p,size_t n)
+{
+  uintptr_t pg = sysconf(_SC_PAGESIZE);
+  uintptr_t a = ((uintptr_t)p+pg-1) & ~(pg-1);
+  uintptr_t b = ((uintptr_t)p+n) & ~(pg-1);
+
+  if (b <= a)
+    return;
+#ifdef SYNC_FILE_RANGE_WRITE
+  sync_file_range(out_fd,(off_t)(a-(uintptr_t)out_map),b-a,SYNC_FILE_RANGE_WRITE);
+#else
+  msync((void *)a,b-a,MS_ASYNC);
+#endif
+  madvise((void *)a,b-a,MADV_DONTNEED);
+}
+
+static void
+out_error(const char *what,const char *path)
+{
+  fprintf(stderr,"%s: %s '%s': ",prog_name,what,path);
+  perror(NULL);
+  exit(1);
+}
+
+/* get o->size bytes to write the digits into */
+void
+digits_map(digits_t *o,size_t size)
+{
+  o->size = size;
+  if (o->fd < 0) {
+    o->buf = malloc(size);
+    return;
+  }
+  if (ftruncate(o->fd,size) < 0)
+    out_error("cannot extend",o->path);
+  o->buf = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED,o->fd,0);
+  if (o->buf==MAP_FAILED)
+    out_error("cannot map",o->path);
+  out_fd = o->fd;
+  out_map = o->buf;
+}
+
+/* send the digits to path, or to stdout if path is NULL */
+void
+digits_open(digits_t *o,const char *path,int format)
+{
+  o->buf = NULL;
+  o->len = o->size = 0;
+  o->path = path;
+  o->format = format;
+  o->fd = -1;
+  if (path) {
+    o->fd = open(path,O_RDWR|O_CREAT|O_TRUNC,0644);
+    if (o->fd < 0)
+      out_error("cannot open",path);
+  }
+}
+
+/* x = x/2^shift * 10^frac rounded, t = 10^frac; the integer part, 3 for pi */
+static unsigned long
+digits_scale(mpz_t x,mpz_t t,long shift,long frac,long threads)
+{
+  unsigned long whole;
+
+  mpz_tdiv_q_2exp(t,x,shift);
+  whole = mpz_get_ui(t);
+
+  if (frac==pre_frac) {
+    mpz_swap(t,pre_scale);
+    mpz_clear(pre_scale);
+    pre_frac = -1;
+  } else
+    radix_pow10(t,frac,threads);
+  pmul(x,x,t,threads);
+  mpz_tdiv_q_2exp(x,x,shift-1);
+  mpz_add_ui(x,x,1);
+  mpz_tdiv_q_2exp(x,x,1);
+  return whole;
+}
+
+/*
+  what digits_write() of d digits in format, to a file or not, on
+  threads workers needs from d alone: the scale 10^frac and the
+  conversion table, on one worker, ahead of it
+*/
+void
+digits_prepare(int format,int file,long d,long threads)
+{
+  size_t blk = file ? OUT_BLOCK : (size_t)-1;
+  long frac = d-series->e10;
+
+  if (pre_frac >= 0)
+    mpz_clear(pre_scale);
+  mpz_init(pre_scale);
+  radix_pow10(pre_scale,frac,1);
+  pre_frac = frac;
+  if (format==OUT_TEXT)
+    radix_prepare(d,OUT_TEXT,blk,threads);
+  else
+    radix_prepare((frac+PACK_DIGITS-1)/PACK_DIGITS,OUT_PACKED,blk/8,threads);
+}
+
+/* the first d digits of the constant = x/2^shift, rounded; x is destroyed */
+void
+digits_write(digits_t *o,mpz_t x,long shift,long d,long threads)
+{
+  size_t words,blk = o->fd < 0 ? (size_t)-1 : OUT_BLOCK;
+  long frac = d-series->e10;
+  unsigned long whole;
+  mpz_t t;
+
+  mpz_init(t);
+  whole = digits_scale(x,t,shift,frac,threads);
+
+  if (o->format==OUT_TEXT) {
+
+    /* 0.314...e1 with the trailing zeros dropped like mpf_out_str */
+    digits_map(o,d+64);
+    o->len = sprintf(o->buf,"%s(0,%ld)=\n0.",series->name,terms);
+    radix_convert(o->buf+o->len,x,d,OUT_TEXT,blk,
+                  o->fd < 0 ? NULL : out_done,threads);
+    if (verify_on)
+      verify_digits(o->buf+o->len,d,OUT_TEXT);
+    o->len += d;
+    while (o->buf[o->len-1]=='0')
+      o->len--;
+    o->len += sprintf(o->buf+o->len,"e%d\n",series->e10);
+
+  } else {
+
+    /* the digits after the point, zero padded to whole words */
+    words = (frac+PACK_DIGITS-1)/PACK_DIGITS;
+    digits_map(o,PACK_HEADER+8*words);
+    memset(o->buf,0,PACK_HEADER);
+    snprintf(o->buf,PACK_HEADER,
+      "#raspberry-pi2 packed digits\nBase: 10\nDigitsPerWord: %d\n"
+      "FirstDigits: %lu.\nTotalDigits: %ld\nTerms: %ld\n",
+      PACK_DIGITS,whole,frac,terms);
+    o->len = PACK_HEADER+8*words;
+
+    mpz_submul_ui(x,t,whole);
+    radix_pow10(t,words*PACK_DIGITS-frac,threads);
+    pmul(x,x,t,threads);
+    if (words)
+      radix_convert(o->buf+PACK_HEADER,x,words,OUT_PACKED,blk/8,
+                    o->fd < 0 ? NULL : out_done,threads);
+    if (verify_on)
+      verify_digits(o->buf+PACK_HEADER,frac,OUT_PACKED);
+
+  }
+  mpz_clear(t);
+}
+
+/* finish the output: stdout gets the buffer, a file is cut to length */
+void
+digits_close(digits_t *o)
+{
+  if (o->fd < 0) {
+    if (o->buf)
+      fwrite(o->buf,1,o->len,stdout);
+    free(o->buf);
+    return;
+  }
+  if (o->buf && munmap(o->buf,o->size) < 0)
+    out_error("cannot unmap",o->path);
+  if (ftruncate(o->fd,o->len) < 0)
+    out_error("cannot truncate",o->path);
+  if (close(o->fd) < 0)
+    out_error("cannot write",o->path);
+  out_fd = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+/* the conversion of digits_stream(): buf[0,ready) is done, [0,sent) went */
+static struct {
+  char *buf;
+  size_t ready,sent,blk;
+  size_t (*span)[2];            /* finished pieces past ready, by offset */
+  int nspan,maxspan,stop;
+  int (*fn)(const char *,size_t,void *);
+  void *arg;
+} st;
+
+static pthread_mutex_t st_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* a piece is done: keep it in order, send what now meets the sent digits */
+static void
+stream_done(char *p,size_t n)
+{
+  size_t lo = p-st.buf;
+  size_t n0;
+  int i;
+
+  pthread_mutex_lock(&st_lock);
+  if (st.nspan==st.maxspan) {
+    st.maxspan = st.maxspan ? 2*st.maxspan : 16;
+    st.span = realloc(st.span,st.maxspan*sizeof(*st.span));
+  }
+  for (i=st.nspan; i>0 && st.span[i-1][0] > lo; i--) {
+    st.span[i][0] = st.span[i-1][0];
+    st.span[i][1] = st.span[i-1][1];
+  }
+  st.span[i][0] = lo;
+  st.span[i][1] = lo+n;
+  st.nspan++;
+
+  for (i=0; i<st.nspan && st.span[i][0]==st.ready; i++)
+    st.ready = st.span[i][1];
+  st.nspan -= i;
+  memmove(st.span,st.span+i,st.nspan*sizeof(*st.span));
+
+  while (!st.stop && st.sent < st.ready) {
+    n0 = st.ready-st.sent < st.blk ? st.ready-st.sent : st.blk;
+    st.stop = st.fn(st.buf+st.sent,n0,st.arg);
+    st.sent += n0;
+  }
+  pthread_mutex_unlock(&st_lock);
+}
+
+/*
+  the first d digits of the constant = x/2^shift, rounded, as "3.1415...",
+  to fn in order in pieces of up to blk bytes; x is destroyed.  Returns 0,
+  or what fn returned to stop.
+*/
+int
+digits_stream(mpz_t x,long shift,long d,size_t blk,
+              int (*fn)(const char *,size_t,void *),void *arg,long threads)
+{
+  long frac = d-series->e10;
+  unsigned long whole;
+  size_t head;
+  mpz_t t;
+
+  mpz_init(t);
+  whole = digits_scale(x,t,shift,frac,threads);
+  mpz_submul_ui(x,t,whole);
+  mpz_clear(t);
+
+  st.buf = malloc(frac+32);
+  head = frac > 0 ? sprintf(st.buf,"%lu.",whole) : sprintf(st.buf,"%lu",whole);
+  st.ready = head;
+  st.sent = st.nspan = st.stop = 0;
+  st.blk = blk;
+  st.fn = fn;
+  st.arg = arg;
+  if (frac > 0)
+    radix_convert(st.buf+head,x,frac,OUT_TEXT,blk,stream_done,threads);
+  else
+    stream_done(st.buf+head,0);
+
+  free(st.buf);
+  free(st.span);
+  st.span = NULL;
+  st.maxspan = 0;
+  return st.stop;
+}
@@ -0,0 +1,326 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Hardware counters, on with --perf.  Every thread opens its own group
+   with perf_event_open the first time it does work: the task clock, and
+   the cycles, instructions and last level cache misses when the CPU
+   lets them be counted.  A tree node, a product and every job that
+   engine->run hands out outside the tree open it, so the workers of
+   div/sqrt, mul and out count too.  A phase of the driver gets the sum
+   of all the groups from its start to its end.
+
+   Each thread charges what its counters say to the tree level it is at:
+   a leaf or a merge product sets its level, as in --trace, for as long
+   as it runs, and the parts of a parallel product that pmul hands to
+   other threads run with the level of the product.  A level started
+   inside another, by a worker that helps while it waits, takes over the
+   counts until it ends, so nothing is counted twice.  That waiting is
+   charged to the level too, spinning included.
+
+   The bandwidth is only estimated, as one 64 byte line per LLC miss, per
+   second of a thread running: prefetches and write-backs are not in it,
+   and it is per thread, not per socket or memory channel, so the line
+   says "est".  IPC and misses per thousand instructions tell a level
+   that waits on memory from one that does not.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define PERF_PHASES   16
+#define PERF_LINE     64        /* bytes one LLC miss brings in */
+
+int perf_on = 0;
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} events[PERF_EVENTS] = {
+  { "task-clock",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+  { "cycles",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "LLC-misses",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+};
+
+/* the counters of one thread */
+typedef struct pbuf {
+  struct pbuf *next;
+  int fd,slot[PERF_EVENTS];     /* slot[k] of event k in a group read */
+  int level;                    /* charged now, -1 for none */
+  uint64_t start[PERF_EVENTS];  /* the counts when it was */
+  uint64_t sum[TRACE_LEVELS][PERF_EVENTS];
+  long count[TRACE_LEVELS];
+} pbuf_t;
+
+static __thread pbuf_t *mine;
+static pbuf_t *all;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int have[PERF_EVENTS];   /* counted on this CPU */
+
+static struct {
+  const char *name;
+  uint64_t v[PERF_EVENTS];
+} phases[PERF_PHASES];
+static int nphases;
+
+static int
+open_event(int k,int group)
+{
+  struct perf_event_attr a;
+
+  memset(&a,0,sizeof(a));
+  a.size = sizeof(a);
+  a.type = events[k].type;
+  a.config = events[k].config;
+  a.exclude_kernel = 1;
+  a.exclude_hv = 1;
+  a.read_format = PERF_FORMAT_GROUP;
+  return (int)syscall(SYS_perf_event_open,&a,0,-1,group,0);
+}
+
+static pbuf_t *
+pbuf(void)
+{
+  pbuf_t *p;
+  int k,n = 0;
+
+  if ((p = mine))
+    return p;
+  p = calloc(1,sizeof(pbuf_t));
+  if (!p) {
+    fprintf(stderr,"%s: out of memory for the counters\n",prog_name);
+    exit(1);
+  }
+  p->level = -1;
+  p->fd = open_event(0,-1);
+  for (k=1; k<PERF_EVENTS; k++) {
+    p->slot[k] = -1;
+    if (have[k] && p->fd >= 0 && open_event(k,p->fd) >= 0)
+      p->slot[k] = ++n;
+  }
+  pthread_mutex_lock(&lock);
+  p->next = all;
+  all = p;
+  pthread_mutex_unlock(&lock);
+  return mine = p;
+}
+
+static void
+read_group(pbuf_t *p,uint64_t *v)
+{
+  uint64_t buf[1+PERF_EVENTS];
+  int k;
+
+  memset(v,0,PERF_EVENTS*sizeof(*v));
+  if (p->fd < 0 || read(p->fd,buf,sizeof(buf)) < (ssize_t)sizeof(uint64_t))
+    return;
+  v[0] = buf[1];
+  for (k=1; k<PERF_EVENTS; k++)
+    if (p->slot[k] >= 0 && p->slot[k] < (int)buf[0])
+      v[k] = buf[1+p->slot[k]];
+}
+
+/* the events the CPU counts, for the thread of main; 0 if none at all */
+int
+perf_start(void)
+{
+  int k,fd;
+
+  for (k=0; k<PERF_EVENTS; k++) {
+    have[k] = (fd = open_event(k,-1)) >= 0;
+    if (have[k])
+      close(fd);
+  }
+  if (!have[0])
+    return 0;
+  perf_on = 1;
+  pbuf();
+  return 1 + have[1] + have[2] + have[3];
+}
+
+/* what the event names are for the header, the ones not counted left out */
+void
+perf_names(char *buf,size_t n)
+{
+  size_t len = 0;
+  int k;
+
+  buf[0] = 0;
+  for (k=0; k<PERF_EVENTS; k++)
+    if (have[k] && len < n)
+      len += snprintf(buf+len,n-len,"%s%s",len ? "," : "",events[k].name);
+}
+
+/* v = the counts of every thread so far */
+void
+perf_total(uint64_t *v)
+{
+  uint64_t w[PERF_EVENTS];
+  pbuf_t *p;
+  int k;
+
+  memset(v,0,PERF_EVENTS*sizeof(*v));
+  if (!perf_on)
+    return;
+  pbuf();
+  pthread_mutex_lock(&lock);
+  for (p=all; p; p=p->next) {
+    read_group(p,w);
+    for (k=0; k<PERF_EVENTS; k++)
+      v[k] += w[k];
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+/* the phase name is what every thread counted since v0 */
+void
+perf_phase(const char *name,const uint64_t *v0)
+{
+  uint64_t v[PERF_EVENTS];
+  int k;
+
+  if (!perf_on || nphases==PERF_PHASES)
+    return;
+  perf_total(v);
+  phases[nphases].name = name;
+  for (k=0; k<PERF_EVENTS; k++)
+    phases[nphases].v[k] = v[k]-v0[k];
+  nphases++;
+}
+
+/* the calling thread's counts go to its level from now to here */
+static void
+charge(pbuf_t *p,uint64_t *now)
+{
+  int k;
+
+  read_group(p,now);
+  if (p->level >= 0)
+    for (k=0; k<PERF_EVENTS; k++)
+      p->sum[p->level][k] += now[k]-p->start[k];
+  memcpy(p->start,now,sizeof(p->start));
+}
+
+/* the calling thread is about to work: count it from now on */
+void
+perf_thread(void)
+{
+  if (perf_on)
+    pbuf();
+}
+
+/* the level of the calling thread now, -1 for none */
+int
+perf_level(void)
+{
+  return perf_on && mine ? mine->level : -1;
+}
+
+/* charge the calling thread to level until perf_leave(old), old returned;
+   with level < 0 it is only counted */
+int
+perf_enter(int level)
+{
+  uint64_t now[PERF_EVENTS];
+  pbuf_t *p;
+  int old;
+
+  if (!perf_on)
+    return -2;
+  p = pbuf();
+  if (level < 0)
+    return -2;
+  charge(p,now);
+  old = p->level;
+  p->level = level < TRACE_LEVELS ? level : TRACE_LEVELS-1;
+  p->count[p->level]++;
+  return old;
+}
+
+void
+perf_leave(int old)
+{
+  uint64_t now[PERF_EVENTS];
+  pbuf_t *p = mine;
+
+  if (old==-2 || !p)
+    return;
+  charge(p,now);
+  p->level = old;
+}
+
+static void
+show(const char *name,const uint64_t *v)
+{
+  double s = v[0]*1e-9,in = (double)v[2];
+
+  fprintf(stderr,"%-11stask s = %8.2f",name,s);
+  if (have[1])
+    fprintf(stderr,"  Gcycles = %8.2f",v[1]*1e-9);
+  if (have[1] && have[2])
+    fprintf(stderr,"  IPC = %5.2f",v[1] ? in/v[1] : 0);
+  if (have[2] && have[3])
+    fprintf(stderr,"  LLC MPKI = %7.3f",in ? v[3]*1e3/in : 0);
+  if (have[3])
+    fprintf(stderr,"  est MB/s/thread (LLC misses) = %8.1f",s > 0 ? v[3]*(double)PERF_LINE/s/1e6 : 0);
+  fprintf(stderr,"\n");
+}
+
+/* the phases, then the tree levels, on stderr */
+void
+perf_report(void)
+{
+  uint64_t v[PERF_EVENTS];
+  char name[32];
+  pbuf_t *p;
+  long count;
+  int i,l,k;
+
+  if (!perf_on)
+    return;
+  fprintf(stderr,"   perf by phase:\n");
+  for (i=0; i<nphases; i++)
+    show(phases[i].name,phases[i].v);
+  fprintf(stderr,"   perf by tree level:\n");
+  for (l=0; l<TRACE_LEVELS; l++) {
+    memset(v,0,sizeof(v));
+    count = 0;
+    for (p=all; p; p=p->next) {
+      for (k=0; k<PERF_EVENTS; k++)
+        v[k] += p->sum[l][k];
+      count += p->count[l];
+    }
+    if (!count)
+      continue;
+    snprintf(name,sizeof(name),"level %d",l);
+    show(name,v);
+  }
+  fflush(stderr);
+}
@@ -0,0 +1,305 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Other constants on the same binary splitting, chosen with --constant.
+   Each one is a hypergeometric series
+
+     value = (a0 + sum_{k>=1} a(k) * prod_{i=1..k} p(i)/q(i)) * num/den
+
+   with q(i) > 0.  The leaf kernel of a series stores g = p(k), p = q(k)
+   and q = a(k)*p(k) for one term k, and folds a block of them in from
+   the left the way the Chudnovsky one in bs_block() does, so bs_merge()
+   and every engine above it, the pool allocator, spilling, checkpoints
+   and the parallel multiply work on these sums as they are; the root
+   gives the sum as q/p.  pi keeps its kernels and its final step, and
+   is the only one with the sieve, --verify, and the cost model of the
+   forloop partition.
+
+ * The kernels are made at compile time by SERIES_BLOCK(): p(k) and q(k)
+   are lists of single-limb factors and a(k) the coefficients of a
+   polynomial in k, all from inline functions and constant arrays, so
+   every factor is one mpn_mul_1 and no call goes through a pointer
+   inside a block.
+
+     e        sum 1/k!
+     ln2      3/4 sum (-1)^k (k!)^2 / (2^k (2k+1)!)
+     zeta3    1/64 sum (-1)^k (205k^2+250k+77) (k!)^10 / ((2k+1)!)^5
+                (Amdeberhan and Zeilberger)
+     catalan  1/64 sum_{k>=1} (-1)^(k-1) 2^(8k) (40k^2-24k+3) ((2k)!)^3
+                (k!)^2 / (k^3 (2k-1) ((4k)!)^2)   (Lupas)
+
+   For Catalan's constant k^3 (2k-1) cancels against the last factor of
+   the product, and with its k = 1 term taken out as a0 the rest runs
+   over j = k-1 >= 1 with the p(j)/q(j) and a(j) below.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define SERIES_GUARD    4       /* digits of terms past the ones asked for */
+#define SERIES_FACTORS  6       /* most limb factors of one p(k) or q(k) */
+#define SERIES_LIMBS    (SERIES_FACTORS*LEAF_TERMS+8)
+
+/* {t,gn+...} = a(k)*{g,gn} by Horner's rule, c[0..n-1] from the top */
+static inline mp_size_t
+horner(mp_ptr t,mp_srcptr g,mp_size_t gn,const mp_limb_t *c,int n,
+       unsigned long k)
+{
+  mp_size_t tn = gn;
+  mp_limb_t cy;
+  int i;
+
+  cy = mpn_mul_1(t,g,gn,c[0]);
+  if (cy)
+    t[tn++] = cy;
+  for (i=1; i<n; i++) {
+    cy = mpn_mul_1(t,t,tn,k);
+    if (cy)
+      t[tn++] = cy;
+    cy = mpn_addmul_1(t,g,gn,c[i]);
+    if (tn > gn)
+      cy = mpn_add_1(t+gn,t+gn,tn-gn,cy);
+    if (cy)
+      t[tn++] = cy;
+  }
+  return tn;
+}
+
+/*
+  SERIES_BLOCK(name,sign) makes name_block(a,b,r) for terms a+1..b out
+  of name_p(k,v) and name_q(k,v), which put the factors of |p(k)| and
+  q(k) in v[] and return how many there are, and name_a[], the
+  coefficients of a(k) >= 0.  sign is the sign of every p(k).  Like
+  bs_block(), g, q and p are folded in from the left on the stack:
+
+    g' = g*p(k)
+    q' = q*q(k) + a(k)*g'
+    p' = p*q(k)
+*/
+#define SERIES_BLOCK(name,sign)                                         \
+static void                                                             \
+name##_block(unsigned long a,unsigned long b,bs_t r)                    \
+{                                                                       \
+  mp_limb_t p[SERIES_LIMBS],q[SERIES_LIMBS],g[SERIES_LIMBS];            \
+  mp_limb_t t[SERIES_LIMBS],v[SERIES_FACTORS];                          \
+  mp_size_t pn = 1,qn = 0,gn = 1,tn;                                    \
+  unsigned long k;                                                      \
+  int n,qs = 1,odd = 0;                                                 \
+                                                                        \
+  p[0] = g[0] = 1;                                                      \
+  for (k=a+1; k<=b; k++) {                                              \
+    odd = sign < 0 && (k-a)%2;                                          \
+    n = name##_p(k,v);                                                  \
+    gn = mul_limbs(g,gn,v,n);                                           \
+    tn = horner(t,g,gn,name##_a,sizeof(name##_a)/sizeof(*name##_a),k);  \
+    n = name##_q(k,v);                                                  \
+    if (qn)                                                             \
+      qn = mul_limbs(q,qn,v,n);                                         \
+    add_signed(q,&qn,&qs,t,tn,odd ? -1 : 1);                            \
+    pn = mul_limbs(p,pn,v,n);                                           \
+  }                                                                     \
+  set_limbs(r->p,p,pn,1);                                               \
+  set_limbs(r->q,q,qn,qs);                                              \
+  set_limbs(r->g,g,gn,odd ? -1 : 1);                                    \
+}
+
+/* terms of a series with a fixed number of digits per term */
+static unsigned long
+linear(long d,double rate)
+{
+  return (unsigned long)((d+SERIES_GUARD)/rate)+1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+static unsigned long
+pi_terms(long d)
+{
+  return d/DIGITS_PER_ITER;
+}
+
+const series_t series_pi = {
+  "pi",0,NULL,0,1,1,1,pi_terms,3,22
+};
+
+////////////////////////////////////////////////////////////////////////////
+
+/* p(k) = 1, q(k) = k, a(k) = 1 */
+static inline int
+e_p(unsigned long k,mp_limb_t *v)
+{
+  (void)k;
+  (void)v;
+  return 0;
+}
+
+static inline int
+e_q(unsigned long k,mp_limb_t *v)
+{
+  v[0] = k;
+  return 1;
+}
+
+static const mp_limb_t e_a[] = { 1 };
+
+SERIES_BLOCK(e,1)
+
+/* the first n with log10(n!) past d */
+static unsigned long
+e_terms(long d)
+{
+  unsigned long n = 1;
+  double s = 0;
+
+  while (s < d+SERIES_GUARD)
+    s += log10((double)++n);
+  return n;
+}
+
+static const series_t series_e = {
+  "e",1,e_block,1,1,1,1,e_terms,2.0/3,0
+};
+
+////////////////////////////////////////////////////////////////////////////
+
+/* p(k) = -k, q(k) = 4(2k+1), a(k) = 1 */
+static inline int
+ln2_p(unsigned long k,mp_limb_t *v)
+{
+  v[0] = k;
+  return 1;
+}
+
+static inline int
+ln2_q(unsigned long k,mp_limb_t *v)
+{
+  v[0] = 2*k+1;
+  v[1] = 4;
+  return 2;
+}
+
+static const mp_limb_t ln2_a[] = { 1 };
+
+SERIES_BLOCK(ln2,-1)
+
+static unsigned long
+ln2_terms(long d)
+{
+  return linear(d,log10(8.0));
+}
+
+static const series_t series_ln2 = {
+  "ln2",2,ln2_block,1,3,4,0,ln2_terms,1,2
+};
+
+////////////////////////////////////////////////////////////////////////////
+
+/* p(k) = -k^5, q(k) = 32(2k+1)^5, a(k) = 205k^2+250k+77 */
+static inline int
+zeta3_p(unsigned long k,mp_limb_t *v)
+{
+  v[0] = v[1] = v[2] = v[3] = v[4] = k;
+  return 5;
+}
+
+static inline int
+zeta3_q(unsigned long k,mp_limb_t *v)
+{
+  v[0] = v[1] = v[2] = v[3] = v[4] = 2*k+1;
+  v[5] = 32;
+  return 6;
+}
+
+static const mp_limb_t zeta3_a[] = { 205,250,77 };
+
+SERIES_BLOCK(zeta3,-1)
+
+static unsigned long
+zeta3_terms(long d)
+{
+  return linear(d,log10(1024.0));
+}
+
+static const series_t series_zeta3 = {
+  "zeta3",3,zeta3_block,77,1,64,1,zeta3_terms,5,20.0/3
+};
+
+////////////////////////////////////////////////////////////////////////////
+
+/* p(j) = -32 j^3 (2j-1), q(j) = (4j+1)^2 (4j+3)^2, a(j) = 40j^2+56j+19,
+   and catalan = (19 + sum)/18 */
+static inline int
+catalan_p(unsigned long k,mp_limb_t *v)
+{
+  v[0] = v[1] = v[2] = k;
+  v[3] = 2*k-1;
+  v[4] = 32;
+  return 5;
+}
+
+static inline int
+catalan_q(unsigned long k,mp_limb_t *v)
+{
+  v[0] = v[1] = 4*k+1;
+  v[2] = v[3] = 4*k+3;
+  return 4;
+}
+
+static const mp_limb_t catalan_a[] = { 40,56,19 };
+
+SERIES_BLOCK(catalan,-1)
+
+static unsigned long
+catalan_terms(long d)
+{
+  return linear(d,log10(4.0));
+}
+
+static const series_t series_catalan = {
+  "catalan",4,catalan_block,19,1,18,0,catalan_terms,4,22.0/3
+};
+
+////////////////////////////////////////////////////////////////////////////
+
+const series_t *series = &series_pi;
+
+const series_t *const series_list[] = {
+  &series_pi,
+  &series_e,
+  &series_ln2,
+  &series_zeta3,
+  &series_catalan,
+  NULL
+};
+
+const series_t *
+find_series(const char *name)
+{
+  int i;
+
+  for (i=0; series_list[i]; i++)
+    if (strcmp(series_list[i]->name,name)==0)
+      return series_list[i];
+  return NULL;
+}
@@ -0,0 +1,329 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Out-of-core binary splitting, on with --memory.  The left result of a
+   node is finished before the right one and then only waits for the
+   merge, as do the chunk results of the forloop and cilk engines until
+   the reduction gets to them.  Results waiting that way stay in memory
+   while their total fits in the --memory budget.  Past it, each waiting
+   result is written to an unlinked file in --spill-dir as raw limbs.
+   Its memory is freed, and the file is mapped back in for the merge.  p
+   and q of a mapped left result are read in place, through mpz_roinit_n
+   views.  Only g is copied back, because the common factor removal
+   divides it in place; a right one, which the merge writes to, is
+   copied back in full by spill_back().
+
+   With --compress a waiting result of SPILL_MIN or more is packed in
+   memory first, and what is left of it counts against the budget.  A
+   general compressor finds nothing in the limbs of p, q and g but the
+   low zero bits of p, the powers of two of k^3*C^3/24, so those are
+   shifted out and put back for the merge.  With the common factor
+   removal on, fp and fg already hold all of the odd part of p and of g:
+   those two are dropped and multiplied back out of the factors before
+   the merge, for about the cost of the subtree's own p*p and g*g
+   products.  A factored form that got out of step, as when a result
+   comes from another rank, is caught by its residues and kept.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define SPILL_MIN  (1L<<20)     /* bytes, smaller results never go out */
+#define PACK_M1    4294967291UL /* the two largest primes below 2^32 */
+#define PACK_M2    4294967279UL
+#define PACK_P     1
+#define PACK_G     2
+
+long spill_budget = -1;         /* bytes of waiting results kept, -1 off */
+const char *spill_dir = ".";
+int spill_compress = 0;
+
+static long idle;               /* bytes of waiting results in memory */
+static long spilled,files;      /* totals for the report */
+static long unpacked,packed;    /* bytes before and after --compress */
+
+struct spill {
+  int fd;
+  size_t len;
+  void *map;
+  long size[3];                 /* signed sizes of p, q, g in limbs */
+  mpz_t p,q;                    /* views of the mapped p and q */
+};
+
+static void
+spill_error(const char *what)
+{
+  fprintf(stderr,"%s: cannot %s spill file in '%s': ",prog_name,what,spill_dir);
+  perror(NULL);
+  exit(1);
+}
+
+static void
+write_all(int fd,const void *buf,size_t n)
+{
+  const char *p = buf;
+  ssize_t w;
+
+  while (n > 0) {
+    if ((w = write(fd,p,n)) < 0)
+      spill_error("write");
+    p += w;
+    n -= w;
+  }
+}
+
+static long
+limb_bytes(bs_t r)
+{
+  return (mpz_size(r->p)+mpz_size(r->q)+mpz_size(r->g))*sizeof(mp_limb_t);
+}
+
+/* x /= 2^k for its k low zero bits, in a block no bigger than it needs */
+static long
+strip(mpz_t x)
+{
+  long k;
+
+  if (!mpz_sgn(x) || !(k = mpz_scan1(x,0)))
+    return 0;
+  mpz_tdiv_q_2exp(x,x,k);
+  mpz_realloc2(x,mpz_sizeinbase(x,2));
+  return k;
+}
+
+/* is f the value of x > 0, by its residues mod PACK_M1 and PACK_M2 */
+static int
+fac_holds(mpz_srcptr x,fac_t f)
+{
+  unsigned long long r1 = 1,r2 = 1,b1,b2;
+  unsigned long i,e;
+
+  if (mpz_sgn(x) <= 0)
+    return 0;
+  for (i=0; i<f->num_facs; i++) {
+    b1 = f->fac[i]%PACK_M1;
+    b2 = f->fac[i]%PACK_M2;
+    for (e=f->pow[i]; e; e>>=1) {
+      if (e&1) {
+        r1 = r1*b1%PACK_M1;
+        r2 = r2*b2%PACK_M2;
+      }
+      b1 = b1*b1%PACK_M1;
+      b2 = b2*b2%PACK_M2;
+    }
+  }
+  return mpz_fdiv_ui(x,PACK_M1)==r1 && mpz_fdiv_ui(x,PACK_M2)==r2;
+}
+
+static void
+pack(bs_t r)
+{
+  long before = limb_bytes(r);
+
+  r->zeros[0] = strip(r->p);
+  r->zeros[1] = strip(r->q);
+  r->zeros[2] = strip(r->g);
+  if (factor && fac_holds(r->p,r->fp)) {
+    mpz_clear(r->p);
+    mpz_init(r->p);
+    r->packed |= PACK_P;
+  }
+  if (factor && fac_holds(r->g,r->fg)) {
+    mpz_clear(r->g);
+    mpz_init(r->g);
+    r->packed |= PACK_G;
+  }
+  __atomic_add_fetch(&unpacked,before,__ATOMIC_RELAXED);
+  __atomic_add_fetch(&packed,limb_bytes(r),__ATOMIC_RELAXED);
+}
+
+/* undo pack(), with *p and *q where the stored p and q are read from */
+static void
+unpack(bs_t r,mpz_srcptr *p,mpz_srcptr *q)
+{
+  if (r->packed & PACK_P) {
+    fac_value(r->p,r->fp);
+    *p = r->p;
+  }
+  if (r->zeros[0]) {
+    mpz_mul_2exp(r->p,*p,r->zeros[0]);
+    *p = r->p;
+  }
+  if (r->zeros[1]) {
+    mpz_mul_2exp(r->q,*q,r->zeros[1]);
+    *q = r->q;
+  }
+  if (r->packed & PACK_G)
+    fac_value(r->g,r->fg);
+  if (r->zeros[2])
+    mpz_mul_2exp(r->g,r->g,r->zeros[2]);
+  r->zeros[0] = r->zeros[1] = r->zeros[2] = 0;
+  r->packed = 0;
+}
+
+/* r is finished and only waits for its merge: keep it or write it out */
+void
+bs_spill(bs_t r)
+{
+  struct spill *s;
+  mpz_ptr z[3];
+  long bytes,now;
+  char *path;
+  int i;
+
+  if (spill_budget < 0 && !spill_compress)
+    return;
+  bytes = limb_bytes(r);
+  if (bytes < SPILL_MIN)
+    return;
+  if (spill_compress) {
+    pack(r);
+    bytes = limb_bytes(r);
+    if (spill_budget < 0)
+      return;
+  }
+
+  now = __atomic_add_fetch(&idle,bytes,__ATOMIC_RELAXED);
+  if (now <= spill_budget) {
+    r->idle = bytes;
+    return;
+  }
+  __atomic_sub_fetch(&idle,bytes,__ATOMIC_RELAXED);
+
+  s = malloc(sizeof(*s));
+  path = malloc(strlen(spill_dir)+32);
+  sprintf(path,"%s/raspberry-pi2-XXXXXX",spill_dir);
+  if ((s->fd = mkstemp(path)) < 0)
+    spill_error("create");
+  unlink(path);
+  free(path);
+
+  z[0] = r->p;
+  z[1] = r->q;
+  z[2] = r->g;
+  for (i=0; i<3; i++)
+    s->size[i] = mpz_sgn(z[i]) < 0 ? -(long)mpz_size(z[i]) : (long)mpz_size(z[i]);
+  write_all(s->fd,s->size,sizeof(s->size));
+  for (i=0; i<3; i++) {
+    write_all(s->fd,mpz_limbs_read(z[i]),mpz_size(z[i])*sizeof(mp_limb_t));
+    mpz_clear(z[i]);
+    mpz_init(z[i]);
+  }
+  s->len = sizeof(s->size)+bytes;
+  s->map = NULL;
+  r->spill = s;
+
+  __atomic_add_fetch(&spilled,bytes,__ATOMIC_RELAXED);
+  __atomic_add_fetch(&files,1,__ATOMIC_RELAXED);
+}
+
+/*
+  Get r ready for a merge: *p and *q are the operands to read p and q
+  from, r->g is back in memory.
+*/
+void
+spill_get(bs_t r,mpz_srcptr *p,mpz_srcptr *q)
+{
+  struct spill *s = r->spill;
+  mp_limb_t *l;
+  long n;
+
+  if (r->idle) {
+    __atomic_sub_fetch(&idle,r->idle,__ATOMIC_RELAXED);
+    r->idle = 0;
+  }
+  *p = r->p;
+  *q = r->q;
+  if (!s) {
+    unpack(r,p,q);
+    return;
+  }
+
+  s->map = mmap(NULL,s->len,PROT_READ,MAP_PRIVATE,s->fd,0);
+  if (s->map==MAP_FAILED)
+    spill_error("map");
+  l = (mp_limb_t *)((char *)s->map+sizeof(s->size));
+  mpz_roinit_n(s->p,l,s->size[0]);
+  l += labs(s->size[0]);
+  mpz_roinit_n(s->q,l,s->size[1]);
+  l += labs(s->size[1]);
+  n = labs(s->size[2]);
+  memcpy(mpz_limbs_write(r->g,n),l,n*sizeof(mp_limb_t));
+  mpz_limbs_finish(r->g,s->size[2]);
+
+  *p = s->p;
+  *q = s->q;
+  unpack(r,p,q);
+}
+
+/* all of r back in its own memory, for a merge that writes to it */
+void
+spill_back(bs_t r)
+{
+  mpz_srcptr p,q;
+
+  spill_get(r,&p,&q);
+  if (p!=r->p)
+    mpz_set(r->p,p);
+  if (q!=r->q)
+    mpz_set(r->q,q);
+  spill_put(r);
+}
+
+/* the merge is done with the mapped operands of r */
+void
+spill_put(bs_t r)
+{
+  struct spill *s = r->spill;
+
+  if (!s)
+    return;
+  munmap(s->map,s->len);
+  close(s->fd);
+  free(s);
+  r->spill = NULL;
+}
+
+/* bytes written out, and in how many files */
+long
+spill_bytes(void)
+{
+  return spilled;
+}
+
+long
+spill_files(void)
+{
+  return files;
+}
+
+/* bytes --compress left of the *before bytes it packed */
+long
+spill_packed(long *before)
+{
+  *before = unpacked;
+  return packed;
+}
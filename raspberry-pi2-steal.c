@@ -0,0 +1,494 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Copyright 2002,2005 Hanhong Xue (macroxue at yahoo dot com)
+
+ * Slightly modified 2005 by Torbjorn Granlund to allow more than 2G
+   digits to be computed.
+
+ * This is the "steal" engine of raspberry-pi2: a small work-stealing pool
+   of pthreads, one deque per worker.  A node of the splitting tree only
+   spawns its left half as a task while the node is big enough to be worth
+   moving to another core, judged from the estimated size of its operands,
+   and while some worker could actually pick it up.  There is no fixed
+   "b-a < 1000" cutoff and no spawn at every level.
+
+   To run:
+   ./raspberry-pi2 --engine=steal 1000000 0 64
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+////////////////////////////////////////////////////////////////////////////
+
+#define DEQUE_SIZE  4096    /* far deeper than any splitting tree */
+
+typedef struct {
+  pthread_mutex_t lock;
+  long top,bot;             /* thieves take from top, the owner from bot */
+  task_t *slot[DEQUE_SIZE];
+} deque_t;
+
+typedef struct {
+  int id;
+  unsigned seed;
+  pthread_t thread;
+  deque_t dq;
+} worker_t;
+
+static worker_t *workers;
+static int nworkers;
+static deque_t inject;      /* tasks handed in from outside the pool */
+
+static long pending;        /* queued, not yet started tasks */
+static int idle;            /* workers asleep on wake */
+static int stopping;        /* workers are to leave, for pool_stop() */
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  finished = PTHREAD_COND_INITIALIZER;
+
+static __thread worker_t *self;
+
+static void
+deque_init(deque_t *q)
+{
+  pthread_mutex_init(&q->lock,NULL);
+  q->top = q->bot = 0;
+}
+
+static int
+deque_push(deque_t *q,task_t *t)
+{
+  int ok;
+
+  pthread_mutex_lock(&q->lock);
+  ok = q->bot-q->top < DEQUE_SIZE;
+  if (ok)
+    q->slot[q->bot++ % DEQUE_SIZE] = t;
+  pthread_mutex_unlock(&q->lock);
+  return ok;
+}
+
+static task_t *
+deque_pop(deque_t *q)
+{
+  task_t *t = NULL;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->bot > q->top)
+    t = q->slot[--q->bot % DEQUE_SIZE];
+  pthread_mutex_unlock(&q->lock);
+  return t;
+}
+
+static task_t *
+deque_steal(deque_t *q)
+{
+  task_t *t = NULL;
+
+  if (__atomic_load_n(&q->bot,__ATOMIC_RELAXED) ==
+      __atomic_load_n(&q->top,__ATOMIC_RELAXED))
+    return NULL;
+  pthread_mutex_lock(&q->lock);
+  if (q->bot > q->top)
+    t = q->slot[q->top++ % DEQUE_SIZE];
+  pthread_mutex_unlock(&q->lock);
+  return t;
+}
+
+static void
+task_run(task_t *t)
+{
+  __atomic_sub_fetch(&pending,1,__ATOMIC_SEQ_CST);
+  t->fn(t->arg);
+  __atomic_store_n(&t->done,1,__ATOMIC_RELEASE);
+  if (t->external) {
+    pthread_mutex_lock(&wake_lock);
+    pthread_cond_broadcast(&finished);
+    pthread_mutex_unlock(&wake_lock);
+  }
+}
+
+/* one steal attempt over all the victims, starting at a random one */
+static task_t *
+steal_any(worker_t *w)
+{
+  task_t *t;
+  int i,v;
+
+  if ((t = deque_steal(&inject)))
+    return t;
+  w->seed = w->seed*1103515245+12345;
+  v = (w->seed>>16) % nworkers;
+  for (i=0; i<nworkers; i++, v=(v+1)%nworkers) {
+    if (&workers[v] != w && (t = deque_steal(&workers[v].dq)))
+      return t;
+  }
+  return NULL;
+}
+
+static void
+notify(void)
+{
+  __atomic_add_fetch(&pending,1,__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&idle,__ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&wake_lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+  }
+}
+
+static void *
+worker_main(void *arg)
+{
+  worker_t *w = arg;
+  task_t *t;
+  int spins = 0;
+  double t0 = 0;          /* when this worker ran out of work */
+
+  self = w;
+  for (;;) {
+    if ((t = steal_any(w))) {
+      if (spins)
+        trace_event(TRACE_IDLE,t0,0,0,0,0);
+      task_run(t);
+      spins = 0;
+    } else if (__atomic_load_n(&stopping,__ATOMIC_ACQUIRE)) {
+      break;
+    } else if (spins++ == 0) {
+      t0 = trace_now();
+    } else if (spins < 64) {
+      sched_yield();
+    } else {
+      pthread_mutex_lock(&wake_lock);
+      __atomic_add_fetch(&idle,1,__ATOMIC_SEQ_CST);
+      while (__atomic_load_n(&pending,__ATOMIC_SEQ_CST)==0 && !stopping)
+        pthread_cond_wait(&wake,&wake_lock);
+      __atomic_sub_fetch(&idle,1,__ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&wake_lock);
+      spins = 1;
+    }
+  }
+  return NULL;
+}
+
+/* the workers leave once the work they have is done, and are joined */
+static void
+pool_stop(void)
+{
+  int i;
+
+  pthread_mutex_lock(&wake_lock);
+  __atomic_store_n(&stopping,1,__ATOMIC_RELEASE);
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&wake_lock);
+  for (i=0; i<nworkers; i++)
+    pthread_join(workers[i].thread,NULL);
+  for (i=0; i<nworkers; i++)
+    pthread_mutex_destroy(&workers[i].dq.lock);
+  pthread_mutex_destroy(&inject.lock);
+  free(workers);
+  workers = NULL;
+  nworkers = 0;
+  stopping = 0;
+}
+
+/* n workers; a pool of another size is stopped and started again */
+void
+pool_start(int n)
+{
+  int i;
+
+  if (n < 1)
+    n = 1;
+  if (workers && n==nworkers)
+    return;
+  if (workers)
+    pool_stop();
+  nworkers = n;
+  workers = calloc(n,sizeof(worker_t));
+  deque_init(&inject);
+  for (i=0; i<n; i++) {
+    workers[i].id = i;
+    workers[i].seed = i+1;
+    deque_init(&workers[i].dq);
+  }
+  for (i=0; i<n; i++)
+    pthread_create(&workers[i].thread,NULL,worker_main,&workers[i]);
+}
+
+int
+pool_workers(void)
+{
+  return nworkers;
+}
+
+int
+pool_idle(void)
+{
+  return __atomic_load_n(&idle,__ATOMIC_RELAXED);
+}
+
+/* would a task spawned now be picked up by someone else? */
+int
+pool_want_task(void)
+{
+  deque_t *q;
+
+  if (!self)
+    return 0;
+  q = &self->dq;
+  return pool_idle() > 0 ||
+         __atomic_load_n(&q->bot,__ATOMIC_RELAXED) ==
+         __atomic_load_n(&q->top,__ATOMIC_RELAXED);
+}
+
+void
+pool_spawn(task_t *t)
+{
+  t->done = 0;
+  t->external = 0;
+  if (!self || !deque_push(&self->dq,t)) {
+    t->fn(t->arg);
+    t->done = 1;
+    return;
+  }
+  notify();
+}
+
+void
+pool_sync(task_t *t)
+{
+  task_t *u;
+  double t0;
+
+  if (__atomic_load_n(&t->done,__ATOMIC_ACQUIRE))
+    return;
+  /* strict fork-join: t is either at the bottom of our deque or stolen */
+  if ((u = deque_pop(&self->dq))) {
+    if (u == t) {
+      task_run(t);
+      return;
+    }
+    deque_push(&self->dq,u);
+  }
+  /* time not spent on stolen tasks while t runs elsewhere is idle */
+  t0 = trace_now();
+  while (!__atomic_load_n(&t->done,__ATOMIC_ACQUIRE)) {
+    if ((u = steal_any(self))) {
+      trace_event(TRACE_IDLE,t0,0,0,0,0);
+      task_run(u);
+      t0 = trace_now();
+    } else {
+      sched_yield();
+    }
+  }
+  trace_event(TRACE_IDLE,t0,0,0,0,0);
+}
+
+/* run fn(arg) on the pool and wait for it, from a thread outside the pool */
+void
+pool_call(void (*fn)(void *),void *arg)
+{
+  task_t t;
+
+  if (self) {
+    fn(arg);
+    return;
+  }
+  t.fn = fn;
+  t.arg = arg;
+  t.done = 0;
+  t.external = 1;
+  while (!deque_push(&inject,&t))
+    sched_yield();
+  notify();
+  pthread_mutex_lock(&wake_lock);
+  while (!__atomic_load_n(&t.done,__ATOMIC_ACQUIRE))
+    pthread_cond_wait(&finished,&wake_lock);
+  pthread_mutex_unlock(&wake_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#define GRAIN_SPLIT  16     /* aim for this many tasks per worker */
+#define GRAIN_MIN    64     /* never spawn below this many terms */
+
+static double grain;        /* spawn cutoff in estimated bits */
+
+/* estimated size of p(a,b) in bits, each term adding what the series'
+   terms add there */
+static double
+node_bits(unsigned long a,unsigned long b)
+{
+  double k = 0.5*(a+b)+1;
+
+  return (b-a)*(series->bits_log*log2(k)+series->bits_one);
+}
+
+typedef struct {
+  unsigned long a,b;
+  bs_struct *r;
+} node_t;
+
+static void bs(unsigned long a,unsigned long b,bs_t r1);
+
+static void
+node_job(void *arg)
+{
+  node_t *n = arg;
+
+  bs(n->a,n->b,n->r);
+  bs_spill(n->r);
+}
+
+/* binary splitting */
+static void
+bs(unsigned long a,unsigned long b,bs_t r1)
+{
+  unsigned long mid;
+  double bits;
+  bs_t r2;
+  node_t left;
+  task_t t;
+
+  if (b-a <= LEAF_TERMS) {
+
+    bs_block(a,b,r1);
+
+  } else {
+
+    bs_init(r2);
+    bits = node_bits(a,b);
+
+    if (b-a==2) {
+      bs_leaf(b-1,r1);
+      bs_leaf(b,r2);
+    } else {
+
+      mid = bs_split(a,b);
+      if (b-a >= GRAIN_MIN && bits >= grain && pool_want_task()) {
+        left.a = a;
+        left.b = mid;
+        left.r = r1;
+        t.fn = node_job;
+        t.arg = &left;
+        pool_spawn(&t);
+        bs(mid,b,r2);
+        pool_sync(&t);
+      } else {
+        bs(a,mid,r1);
+        bs_spill(r1);
+        bs(mid,b,r2);
+      }
+    }
+
+    /* only merges well above the grain are worth splitting three ways */
+    bs_merge(r1,r2,BS_GFLAG(b),bits >= 4*grain ? nworkers : 1);
+    bs_clear(r2);
+
+  }
+}
+
+static void
+steal_init(long threads)
+{
+  pool_start(threads);
+}
+
+static void
+root_job(void *arg)
+{
+  bs(bs_first,terms,arg);
+}
+
+static void
+steal_bs(bs_t r,long threads)
+{
+  grain = node_bits(bs_first,terms)/(GRAIN_SPLIT*(double)nworkers);
+  pool_call(root_job,r);
+}
+
+typedef struct {
+  void (*job)(int,void *);
+  void *arg;
+  int i;
+} job_t;
+
+static void
+job_task(void *arg)
+{
+  job_t *j = arg;
+
+  j->job(j->i,j->arg);
+}
+
+typedef struct {
+  int n;
+  void (*job)(int,void *);
+  void *arg;
+} run_t;
+
+static void
+run_all(void *arg)
+{
+  run_t *r = arg;
+  job_t *j;
+  task_t *t;
+  int i;
+
+  j = malloc(r->n*sizeof(job_t));
+  t = malloc(r->n*sizeof(task_t));
+  for (i=0; i<r->n-1; i++) {
+    j[i].job = r->job;
+    j[i].arg = r->arg;
+    j[i].i = i;
+    t[i].fn = job_task;
+    t[i].arg = &j[i];
+    pool_spawn(&t[i]);
+  }
+  r->job(r->n-1,r->arg);
+  for (i=r->n-2; i>=0; i--)
+    pool_sync(&t[i]);
+  free(j);
+  free(t);
+}
+
+static void
+steal_run(int n,void (*job)(int,void *),void *arg)
+{
+  run_t r;
+
+  r.n = n;
+  r.job = job;
+  r.arg = arg;
+  pool_call(run_all,&r);
+}
+
+const engine_t engine_steal = {
+  "steal",steal_init,steal_bs,steal_run
+};
@@ -0,0 +1,252 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Execution trace, on with --trace=<file>.  The leaves, the products of
+   every merge and the idle spans of the steal pool, and of the threads
+   of the nested engine waiting at a join, are timed on the thread they
+   run on.  The file is in the Chrome trace event format and
+   loads into chrome://tracing or Perfetto.  One track shows per worker
+   thread, and the driver phases appear on the thread of main.
+
+   A node is placed by its size: level = log2(terms/(b-a)), which is its
+   depth for an even split.  Every thread sums the time, count and result
+   bits of each kind of event per level.  The file ends with these sums
+   per level, and with the busy time of every worker, next to the trace
+   events.  Single events shorter than TRACE_MIN seconds only go into the
+   sums, which keeps the file small at big digit counts.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define TRACE_MIN     1e-4      /* seconds, shorter events are only summed */
+
+int trace_on = 0;
+
+static const char *names[TRACE_KINDS] = {
+  "leaf","p1*p2","q1*p2","q2*g1","g1*g2","idle","phase"
+};
+
+typedef struct {
+  const char *name;
+  int kind,level;
+  double t0,t1;
+  unsigned long a,b;
+  long bits[2];
+} event_t;
+
+/* what one thread has seen */
+typedef struct tbuf {
+  struct tbuf *next;
+  int tid;
+  long n,max;
+  event_t *ev;
+  double sec[TRACE_LEVELS][TRACE_KINDS];
+  double bits[TRACE_LEVELS][TRACE_KINDS];
+  long count[TRACE_LEVELS][TRACE_KINDS];
+} tbuf_t;
+
+static __thread tbuf_t *mine;
+static tbuf_t *all;
+static int ntids;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *trace_path;
+static double origin;
+
+static tbuf_t *
+tbuf(void)
+{
+  if (!mine) {
+    mine = calloc(1,sizeof(tbuf_t));
+    pthread_mutex_lock(&lock);
+    mine->tid = ntids++;
+    mine->next = all;
+    all = mine;
+    pthread_mutex_unlock(&lock);
+  }
+  return mine;
+}
+
+void
+trace_open(const char *path)
+{
+  trace_path = path;
+  origin = wall_clock();
+  trace_on = 1;
+  tbuf();                     /* main is thread 0 */
+}
+
+double
+trace_now(void)
+{
+  return trace_on ? wall_clock() : 0;
+}
+
+/* the level of the node [a,b), its depth for an even split */
+int
+trace_level(unsigned long a,unsigned long b)
+{
+  int l;
+
+  if (b <= a || terms <= 0)
+    return 0;
+  l = (int)floor(log2((double)terms/(b-a)));
+  return l < 0 ? 0 : l >= TRACE_LEVELS ? TRACE_LEVELS-1 : l;
+}
+
+static void
+record(const char *name,int kind,double t0,double t1,unsigned long a,
+       unsigned long b,long bits0,long bits1)
+{
+  tbuf_t *t = tbuf();
+  int l = kind==TRACE_PHASE ? 0 : trace_level(a,b);
+  event_t *e;
+
+  t->sec[l][kind] += t1-t0;
+  t->bits[l][kind] += bits0;
+  t->count[l][kind]++;
+  if (t1-t0 < TRACE_MIN && kind!=TRACE_PHASE)
+    return;
+  if (t->n==t->max) {
+    t->max = t->max ? 2*t->max : 1024;
+    t->ev = realloc(t->ev,t->max*sizeof(event_t));
+  }
+  e = &t->ev[t->n++];
+  e->name = name;
+  e->kind = kind;
+  e->level = l;
+  e->t0 = t0;
+  e->t1 = t1;
+  e->a = a;
+  e->b = b;
+  e->bits[0] = bits0;
+  e->bits[1] = bits1;
+}
+
+/* one event of [a,b) that started at t0 and ends now */
+void
+trace_event(int kind,double t0,unsigned long a,unsigned long b,long bits0,long bits1)
+{
+  if (trace_on)
+    record(names[kind],kind,t0,wall_clock(),a,b,bits0,bits1);
+}
+
+/* a driver phase, between two wall clock readings */
+void
+trace_phase(const char *name,double t0,double t1)
+{
+  if (trace_on)
+    record(name,TRACE_PHASE,t0,t1,0,0,0,0);
+}
+
+/* write the file, -1 if it could not be */
+long
+trace_close(void)
+{
+  FILE *f;
+  tbuf_t *t;
+  event_t *e;
+  double sec[TRACE_KINDS],busy;
+  long i,n = 0,count[TRACE_KINDS];
+  int l,k,first,used;
+
+  if (!trace_on)
+    return 0;
+  trace_on = 0;
+  if (!(f = fopen(trace_path,"w")))
+    return -1;
+
+  fprintf(f,"{\"traceEvents\":[\n");
+  first = 1;
+  for (t=all; t; t=t->next) {
+    fprintf(f,"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+      "\"args\":{\"name\":\"%s %d\"}}",first ? "" : ",\n",t->tid,
+      t->tid ? "worker" : "main",t->tid);
+    first = 0;
+    for (i=0; i<t->n; i++) {
+      e = &t->ev[i];
+      fprintf(f,",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+        "\"ts\":%.1f,\"dur\":%.1f",e->name,names[e->kind],t->tid,
+        (e->t0-origin)*1e6,(e->t1-e->t0)*1e6);
+      if (e->kind==TRACE_PHASE)
+        fprintf(f,"}");
+      else
+        fprintf(f,",\"args\":{\"level\":%d,\"a\":%lu,\"b\":%lu,\"bits\":[%ld,%ld]}}",
+          e->level,e->a,e->b,e->bits[0],e->bits[1]);
+      n++;
+    }
+  }
+  fprintf(f,"\n],\n\"displayTimeUnit\":\"ms\",\n");
+
+  /* seconds, counts and mean result bits per level and kind, all threads */
+  fprintf(f,"\"levels\":[");
+  first = 1;
+  for (l=0; l<TRACE_LEVELS; l++) {
+    used = 0;
+    for (k=0; k<TRACE_PHASE; k++) {
+      sec[k] = 0;
+      count[k] = 0;
+      for (t=all; t; t=t->next) {
+        sec[k] += t->sec[l][k];
+        count[k] += t->count[l][k];
+      }
+      used |= count[k] > 0;
+    }
+    if (!used)
+      continue;
+    fprintf(f,"%s\n{\"level\":%d",first ? "" : ",",l);
+    first = 0;
+    for (k=0; k<TRACE_PHASE; k++) {
+      double bits = 0;
+
+      if (!count[k])
+        continue;
+      for (t=all; t; t=t->next)
+        bits += t->bits[l][k];
+      fprintf(f,",\"%s\":{\"seconds\":%.6f,\"count\":%ld,\"bits\":%.0f}",
+        names[k],sec[k],count[k],bits/count[k]);
+    }
+    fprintf(f,"}");
+  }
+  fprintf(f,"\n],\n");
+
+  /* time each thread spent in leaves and products, and idle in the pool */
+  fprintf(f,"\"workers\":[");
+  for (t=all; t; t=t->next) {
+    busy = 0;
+    sec[0] = 0;
+    for (l=0; l<TRACE_LEVELS; l++) {
+      for (k=0; k<TRACE_IDLE; k++)
+        busy += t->sec[l][k];
+      sec[0] += t->sec[l][TRACE_IDLE];
+    }
+    fprintf(f,"%s\n{\"tid\":%d,\"busy\":%.6f,\"idle\":%.6f}",
+      t==all ? "" : ",",t->tid,busy,sec[0]);
+  }
+  fprintf(f,"\n]}\n");
+  if (fclose(f)!=0)
+    return -1;
+  return n;
+}
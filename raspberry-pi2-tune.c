@@ -0,0 +1,272 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Split ratio and parallel cutoff of the binary splitting, calibrated per
+   host.  mid = a+(b-a)*split_ratio is where every engine splits a node,
+   and nodes below split_cutoff terms are not split across threads by the
+   nested engine.  The defaults, 0.5224 and 1000, were tuned on a
+   Raspberry Pi 2.
+
+   With --calibrate, or on the first run on a host with no saved values,
+   short splitting runs of TUNE_TERMS terms time a few ratios and then,
+   with two threads or more, a few cutoffs on the chosen engine.  The best
+   values go into the tune file, one line per host and GMP version, so
+   one file can be shared by several machines.  Only measured values are
+   saved: a line without a cutoff, from a one-thread run, is calibrated
+   again by the first run with more threads.  When the tune file cannot
+   be written the first run does not calibrate by itself, since every
+   run after it would too; the defaults stay until --calibrate.  --split
+   and --cutoff override both.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define TUNE_TERMS  16000       /* terms of one timing run, ~230k digits */
+#define TUNE_REPS   3           /* best of */
+#define TUNE_LINE   256
+
+double split_ratio = 0.5224;
+long split_cutoff = 1000;
+const char *tune_file = NULL;
+static int cutoff_known = 0;    /* split_cutoff was measured, saved or timed */
+
+static const double ratios[] = { 0.45, 0.5, 0.5224, 0.55, 0.6 };
+static const long cutoffs[] = { 250, 500, 1000, 2000, 4000 };
+
+/* the key of this host's line in the tune file */
+static void
+tune_key(char *key,size_t n)
+{
+  struct utsname u;
+
+  if (uname(&u)!=0)
+    strcpy(u.nodename,"unknown");
+  snprintf(key,n,"%s gmp-%s",u.nodename,gmp_version);
+}
+
+/* the split ratio and cutoff saved for this host: 0 if none, 1 if only
+   the ratio, 2 if both */
+int
+tune_load(void)
+{
+  char key[TUNE_LINE],line[TUNE_LINE];
+  double r;
+  long c;
+  size_t n;
+  FILE *f;
+  int found = 0,k;
+
+  if (!tune_file || !(f = fopen(tune_file,"r")))
+    return 0;
+  tune_key(key,sizeof(key));
+  n = strlen(key);
+  while (fgets(line,sizeof(line),f)) {
+    if (strncmp(line,key,n)==0 && line[n]==' ' &&
+        (k = sscanf(line+n," split=%lf cutoff=%ld",&r,&c)) >= 1 &&
+        r > 0 && r < 1) {
+      split_ratio = r;
+      found = 1;
+      if (k==2 && c > 0) {
+        split_cutoff = c;
+        cutoff_known = 1;
+        found = 2;
+      }
+    }
+  }
+  fclose(f);
+  return found;
+}
+
+/* replace this host's line in the tune file; 0 if it could not be */
+int
+tune_save(void)
+{
+  char key[TUNE_LINE],line[TUNE_LINE],*tmp;
+  size_t n;
+  FILE *f,*o;
+
+  if (!tune_file)
+    return 0;
+  tune_key(key,sizeof(key));
+  n = strlen(key);
+  tmp = malloc(strlen(tune_file)+8);
+  sprintf(tmp,"%s.tmp",tune_file);
+  if (!(o = fopen(tmp,"w"))) {
+    fprintf(stderr,"%s: cannot write '%s', tuning not saved\n",prog_name,tmp);
+    free(tmp);
+    return 0;
+  }
+  if ((f = fopen(tune_file,"r"))) {
+    while (fgets(line,sizeof(line),f))
+      if (!(strncmp(line,key,n)==0 && line[n]==' '))
+        fputs(line,o);
+    fclose(f);
+  } else {
+    fprintf(o,"# raspberry-pi2 --calibrate: <host> <gmp> split=<ratio> cutoff=<terms>\n");
+  }
+  if (cutoff_known)
+    fprintf(o,"%s split=%.4f cutoff=%ld\n",key,split_ratio,split_cutoff);
+  else
+    fprintf(o,"%s split=%.4f\n",key,split_ratio);
+  if (fclose(o)!=0 || rename(tmp,tune_file)!=0) {
+    fprintf(stderr,"%s: cannot write '%s', tuning not saved\n",prog_name,tune_file);
+    remove(tmp);
+    free(tmp);
+    return 0;
+  }
+  free(tmp);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  unsigned long a,b,n;
+  bs_struct *r;
+  int tds;
+} half_t;
+
+static void tune_bs(unsigned long a,unsigned long b,unsigned long n,bs_t r1,int tds);
+
+static void
+half_job(int i,void *arg)
+{
+  half_t *h = arg;
+
+  tune_bs(h[i].a,h[i].b,h[i].n,h[i].r,h[i].tds);
+}
+
+/* [a,b) of n terms, split the way the nested engine does */
+static void
+tune_bs(unsigned long a,unsigned long b,unsigned long n,bs_t r1,int tds)
+{
+  unsigned long mid;
+  half_t h[2];
+  bs_t r2;
+
+  if (b-a <= LEAF_TERMS) {
+    bs_block(a,b,r1);
+    return;
+  }
+  bs_init(r2);
+  mid = bs_split(a,b);
+  if (b-a < (unsigned long)split_cutoff || tds < 2) {
+    tune_bs(a,mid,n,r1,1);
+    tune_bs(mid,b,n,r2,1);
+  } else {
+    h[0].a = a;
+    h[0].b = mid;
+    h[0].r = r1;
+    h[0].tds = tds/2;
+    h[1].a = mid;
+    h[1].b = b;
+    h[1].r = r2;
+    h[1].tds = tds-tds/2;
+    h[0].n = h[1].n = n;
+    engine->run(2,half_job,h);
+  }
+  bs_merge(r1,r2,b < n,b-a < (unsigned long)split_cutoff ? 1 : tds);
+  bs_clear(r2);
+}
+
+/* best wall time of a few runs with the current ratio and cutoff */
+static double
+tune_time(int tds)
+{
+  double best = 0,t;
+  bs_t r;
+  int i;
+
+  for (i=0; i<TUNE_REPS; i++) {
+    bs_init(r);
+    t = wall_clock();
+    tune_bs(0,TUNE_TERMS,TUNE_TERMS,r,tds);
+    t = wall_clock()-t;
+    bs_clear(r);
+    if (i==0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+/* time the candidates, keep the fastest and save them */
+void
+tune_calibrate(long threads)
+{
+  double begin,wbegin,end,wend,t,best,r = split_ratio;
+  long c = split_cutoff;
+  int i,saved,save_factor = factor;
+  long save_budget = spill_budget;
+
+  fprintf(stderr,"# calibrating the split ratio%s for this host, --split and --cutoff skip it\n",
+    threads > 1 ? " and cutoff" : "");
+  fflush(stderr);
+  begin = cpu_time();
+  wbegin = wall_clock();
+
+  /* plain runs: no sieve yet, nothing goes to disk */
+  factor = 0;
+  spill_budget = -1;
+
+  best = 0;
+  for (i=0; i<(int)(sizeof(ratios)/sizeof(*ratios)); i++) {
+    split_ratio = ratios[i];
+    t = tune_time(1);
+    if (i==0 || t < best) {
+      best = t;
+      r = ratios[i];
+    }
+  }
+  split_ratio = r;
+
+  if (threads > 1) {
+    best = 0;
+    for (i=0; i<(int)(sizeof(cutoffs)/sizeof(*cutoffs)); i++) {
+      split_cutoff = cutoffs[i];
+      t = tune_time(threads);
+      if (i==0 || t < best) {
+        best = t;
+        c = cutoffs[i];
+      }
+    }
+    split_cutoff = c;
+    cutoff_known = 1;
+  }
+
+  factor = save_factor;
+  spill_budget = save_budget;
+  saved = tune_save();
+
+  end = cpu_time();
+  wend = wall_clock();
+  fprintf(stderr,"calibrate  cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    end-begin,wend-wbegin,cpu_factor(end-begin,wend-wbegin));
+  fprintf(stderr,"   split=%.4f",split_ratio);
+  if (cutoff_known)
+    fprintf(stderr," cutoff=%ld",split_cutoff);
+  fprintf(stderr,"%s%s\n",saved ? " saved in " : "",saved ? tune_file : "");
+  fflush(stderr);
+}
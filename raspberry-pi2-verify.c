@@ -0,0 +1,364 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Self check of a run, on with --verify.  A few hex digits at late
+   positions are computed on their own with the BBP formula
+
+     frac(16^n pi) = frac( 4 S(1) - 2 S(4) - S(5) - S(6) ),
+     S(j) = sum_k 16^(n-k)/(8k+j)
+
+   and compared with the same bits of the computed pi, before the radix
+   conversion.  Every term with k <= n is 16^(n-k) mod (8k+j) by binary
+   powering, divided into a 128-bit fraction, so the sums wrap mod 1 by
+   themselves; that is O(n log n) time and no memory, and the k range is
+   cut between the threads.  Each term is off by less than one unit of
+   2^-128, so the 8(n+VERIFY_TAIL) units the sum can be off by stay far
+   below 2^-64 for any n a run reaches.  Rounded to 64 bits, it has to
+   agree with pi to within the last unit or two that pi itself is off
+   by, which checks all 16 hex digits but the last bit or so.
+
+ * When digits are written, a 64-bit FNV-1a hash runs over them, the 3
+   included, and is checked at every power of ten against the table of
+   known[] values.  The last digit written is rounded, so only the powers
+   below the digit count are checked.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+#define VERIFY_TAIL   32        /* terms past k = n that still move 2^-128 */
+#define VERIFY_ULPS   2         /* units of 2^-64 the bits of pi are off by */
+#define FNV_BASIS     0xcbf29ce484222325ULL
+#define FNV_PRIME     0x100000001b3ULL
+
+int verify_on = 0;
+
+static long verify_pos[VERIFY_MAX];
+static int verify_n = 0;
+
+/* FNV-1a of the first 10^i digits of pi, "3141592653..." */
+static const struct {
+  int i;
+  uint64_t h;
+} known[] = {
+  { 1, 0x1edd2705586d9548ULL },
+  { 2, 0x7cd1330dbc5707aaULL },
+  { 3, 0x2073918a0a5fa839ULL },
+  { 4, 0x4233864b6ea49dd2ULL },
+  { 5, 0xc52ad0a22c947903ULL },
+  { 6, 0xd1eedead71b55719ULL },
+  { 7, 0x0179961a6ed31eedULL },
+  { 8, 0x4fc4caffabc2aebaULL },
+};
+
+/* the hex positions of a --verify=n,n,... list, 0 if it is not one */
+int
+verify_parse(const char *list)
+{
+  char *end;
+
+  verify_on = 1;
+  verify_n = 0;
+  while (*list) {
+    if (verify_n==VERIFY_MAX)
+      return 0;
+    verify_pos[verify_n] = strtol(list,&end,10);
+    if (end==list || verify_pos[verify_n] < 0 || (*end && *end!=','))
+      return 0;
+    verify_n++;
+    list = *end ? end+1 : end;
+  }
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+/* a*b mod m, for m < 2^48 and inv = 1/m; the quotient is off by at
+   most one */
+static uint64_t
+mulmod(uint64_t a,uint64_t b,uint64_t m,double inv)
+{
+  uint64_t q = (uint64_t)((double)a*(double)b*inv);
+  int64_t r = (int64_t)(a*b-q*m);
+
+  if (r < 0)
+    r += m;
+  else if ((uint64_t)r >= m)
+    r -= m;
+  return r;
+}
+
+/* r[t] = 16^e = 2^(4e) mod m[t] for the four moduli of one k, left to
+   right: a squaring per bit of 4e and a doubling for every set bit.  The
+   four chains are independent, so their latencies overlap */
+static void
+powmod16(uint64_t e,const uint64_t *m,uint64_t *r)
+{
+  uint64_t x = 4*e,bit;
+  double inv[4];
+  int t;
+
+  for (t=0; t<4; t++) {
+    inv[t] = 1.0/m[t];
+    r[t] = 1;
+  }
+  for (bit=1; bit <= x/2; bit <<= 1)
+    ;
+  for (; bit; bit >>= 1)
+    for (t=0; t<4; t++) {
+      r[t] = mulmod(r[t],r[t],m[t],inv[t]);
+      if (x&bit) {
+        r[t] <<= 1;
+        if (r[t] >= m[t])
+          r[t] -= m[t];
+      }
+    }
+  for (t=0; t<4; t++)
+    r[t] %= m[t];
+}
+
+/* a 128-bit fraction, mod 1 */
+typedef struct {
+  uint64_t hi,lo;
+} frac_t;
+
+/* floor(r*2^(128-s)/m) for r < m < 2^48, 16 bits at a time */
+static frac_t
+fraction(uint64_t r,uint64_t m,int s)
+{
+  frac_t f = { 0,0 };
+  int i;
+
+  for (i=0; i<8; i++) {
+    r <<= 16;
+    f.hi = f.hi<<16 | f.lo>>48;
+    f.lo = f.lo<<16 | r/m;
+    r %= m;
+  }
+  if (s >= 64) {
+    f.lo = f.hi >> (s-64);
+    f.hi = 0;
+  } else if (s > 0) {
+    f.lo = f.lo>>s | f.hi<<(64-s);
+    f.hi >>= s;
+  }
+  return f;
+}
+
+/* *a += c*f mod 1, c small */
+static void
+add_frac(frac_t *a,frac_t f,int c)
+{
+  for (; c > 0; c--) {
+    a->lo += f.lo;
+    a->hi += f.hi + (a->lo < f.lo);
+  }
+  for (; c < 0; c++) {
+    a->hi -= f.hi + (a->lo < f.lo);
+    a->lo -= f.lo;
+  }
+}
+
+typedef struct {
+  uint64_t n;
+  frac_t sum[VERIFY_THREADS];
+  int parts;
+} bbp_t;
+
+static void
+bbp_job(int i,void *arg)
+{
+  bbp_t *b = arg;
+  uint64_t k,m[4],r[4],e;
+  uint64_t lo = b->n/b->parts*i,hi = i==b->parts-1 ? b->n+1 : b->n/b->parts*(i+1);
+  static const int j[4] = { 1,4,5,6 };
+  static const int c[4] = { 4,-2,-1,-1 };
+  frac_t s = { 0,0 };
+  int t;
+
+  perf_thread();
+  for (k=lo; k<hi; k++) {
+    for (t=0; t<4; t++)
+      m[t] = 8*k+j[t];
+    powmod16(b->n-k,m,r);
+    for (t=0; t<4; t++)
+      add_frac(&s,fraction(r[t],m[t],0),c[t]);
+  }
+  if (i==b->parts-1)
+    for (e=1; e<VERIFY_TAIL; e++)
+      for (t=0; t<4; t++)
+        add_frac(&s,fraction(1,8*(b->n+e)+j[t],4*e),c[t]);
+  b->sum[i] = s;
+}
+
+/* 64 bits of frac(16^n pi) */
+static uint64_t
+bbp(uint64_t n,long threads)
+{
+  bbp_t b;
+  frac_t s = { 0,0 };
+  int i;
+
+  b.n = n;
+  b.parts = threads < VERIFY_THREADS ? threads : VERIFY_THREADS;
+  if ((uint64_t)b.parts > n+1)
+    b.parts = 1;
+  if (b.parts < 2)
+    run_serial(1,bbp_job,&b);
+  else
+    engine->run(b.parts,bbp_job,&b);
+  for (i=0; i<b.parts; i++)
+    add_frac(&s,b.sum[i],1);
+  return s.hi + (s.lo >> 63);
+}
+
+/* bits [lo,lo+64) of x */
+static uint64_t
+bits64(mpz_srcptr x,long lo)
+{
+  uint64_t r = 0;
+  int i;
+
+  for (i=63; i>=0; i--)
+    r = r<<1 | (lo+i >= 0 && mpz_tstbit(x,lo+i));
+  return r;
+}
+
+/* check pi = x/2^shift, good to bits fraction bits, at the chosen hex
+   positions, or at the last one if none were given; with fewer than 64
+   bits only those are compared */
+void
+verify_hex(mpz_srcptr x,long shift,long bits,long threads)
+{
+  uint64_t mine,theirs;
+  int64_t diff;
+  long last = (bits-64)/4,drop;
+  int i,bad = 0;
+
+  if (bits < 1) {
+    fprintf(stderr,"   hex: no fraction bits to check\n");
+    return;
+  }
+  if (last < 0)
+    last = 0;
+  if (verify_n==0)
+    verify_pos[verify_n++] = last;
+  for (i=0; i<verify_n; i++)
+    if (verify_pos[i] > last) {
+      fprintf(stderr,"%s: --verify position %ld is past the last hex digit, %ld\n",
+        prog_name,verify_pos[i],last);
+      exit(1);
+    }
+  for (i=0; i<verify_n; i++) {
+    /* below 64 bits only the top ones of the word were computed */
+    drop = bits-4*verify_pos[i] < 64 ? 64-(bits-4*verify_pos[i]) : 0;
+    theirs = bbp(verify_pos[i],threads) >> drop << drop;
+    mine = bits64(x,shift-4*verify_pos[i]-64) >> drop << drop;
+    diff = (int64_t)(theirs-mine) >> drop;
+    /* the BBP sum is truncated, so the last bits may be off by a few */
+    fprintf(stderr,"   hex %ld: bbp=%016" PRIx64 " pi=%016" PRIx64 " %s",
+      verify_pos[i],theirs,mine,
+      diff <= VERIFY_ULPS && diff >= -VERIFY_ULPS ? "ok" : "WRONG");
+    if (diff && diff <= VERIFY_ULPS && diff >= -VERIFY_ULPS)
+      fprintf(stderr," (%+" PRId64 " ulp, within the +-%d allowed)",diff,VERIFY_ULPS);
+    fprintf(stderr,"\n");
+    bad |= diff > VERIFY_ULPS || diff < -VERIFY_ULPS;
+  }
+  fflush(stderr);
+  if (bad) {
+    fprintf(stderr,"%s: the digits do not match the BBP formula\n",prog_name);
+    exit(1);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+typedef struct {
+  uint64_t h;
+  size_t done,next,n;
+  int p,k,checked,bad;
+} fnv_t;
+
+/* one more digit; at 10^p of them, below n, compare with known[] */
+static void
+feed(fnv_t *s,int c)
+{
+  int nk = sizeof(known)/sizeof(*known);
+
+  s->h = (s->h^(unsigned char)c)*FNV_PRIME;
+  if (++s->done!=s->next || s->next >= s->n)
+    return;
+  while (s->k < nk && known[s->k].i < s->p)
+    s->k++;
+  if (s->k < nk && known[s->k].i==s->p) {
+    s->checked = s->p;
+    if (s->h!=known[s->k].h) {
+      fprintf(stderr,"   hash of 10^%d digits=%016" PRIx64 " known=%016" PRIx64 " WRONG\n",
+        s->p,s->h,known[s->k].h);
+      s->bad = 1;
+    }
+  }
+  s->next *= 10;
+  s->p++;
+}
+
+/* hash the n digits at buf, text or the packed words after the 3, and
+   compare with the known values */
+void
+verify_digits(const char *buf,size_t n,int format)
+{
+  fnv_t s;
+  uint64_t w;
+  char word[PACK_DIGITS];
+  size_t i;
+  int j;
+
+  s.h = FNV_BASIS;
+  s.done = s.checked = s.bad = s.k = 0;
+  s.next = 10;
+  s.p = 1;
+  if (format==OUT_PACKED) {
+    s.n = n+1;
+    feed(&s,'3');
+    for (i=0; s.done < s.n; i++) {
+      memcpy(&w,buf+8*i,8);
+      for (j=PACK_DIGITS-1; j>=0; j--, w/=10)
+        word[j] = '0'+w%10;
+      for (j=0; j<PACK_DIGITS && s.done < s.n; j++)
+        feed(&s,word[j]);
+    }
+  } else {
+    s.n = n;
+    for (i=0; i<n; i++)
+      feed(&s,buf[i]);
+  }
+  if (s.checked)
+    fprintf(stderr,"   hash of 10^%d digits %s\n",s.checked,s.bad ? "WRONG" : "ok");
+  fflush(stderr);
+  if (s.bad) {
+    fprintf(stderr,"%s: the digits do not match the known hashes\n",prog_name);
+    exit(1);
+  }
+}
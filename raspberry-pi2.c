@@ -0,0 +1,640 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Copyright 2002,2005 Hanhong Xue (macroxue at yahoo dot com)
+
+ * Slightly modified 2005 by Torbjorn Granlund to allow more than 2G
+   digits to be computed.
+
+ * Modified 2010,2020 by David Carver (dcarver at tacc dot utexas dot edu) to
+   demonstrate a parallel and fully recursive version of the gmp-chudnovsky;
+   to simpilfy OpenMP and improve performance; and incorperate excellent
+   ideas for nested parallelism from Mario Roy implementation at
+   https://github.com/marioroy/Chudnovsky-Pi.
+
+ * Driver for all of the parallel engines: the binary splitting itself is
+   done by the engine chosen with --engine, the rest is shared.  The
+   options, the timing of every phase and the output are here; the final
+   step is in raspberry-pi2-lib.c, which libchudnovsky uses as well.
+
+   To compile:
+   make
+
+   To run:
+   ./raspberry-pi2 1000 1
+   ./raspberry-pi2 --engine=task 1000000 0 4
+
+   To get help run the program with no options:
+   ./raspberry-pi2
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/sysinfo.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <gmp.h>
+#include "raspberry-pi2.h"
+
+static void
+usage(void)
+{
+  int i;
+
+  fprintf(stderr,"\nSyntax: %s [--engine=<name>] [--output=<file>] [--format=<fmt>]\n"
+                 "          [--lowmem] [--alloc=<name>] [--memory=<MB>] [--spill-dir=<dir>]\n"
+                 "          [--checkpoint=<dir>] [--extend=<file>] [--cache=<dir>] [--batch=<file>]\n"
+                 "          [--compress] [--chunks=<n>] [--numa] [--pipeline] [--calibrate]\n"
+                 "          [--split=<ratio>] [--cutoff=<terms>] [--tune-file=<file>]\n"
+                 "          [--trace=<file>] [--perf] [--verify[=<hex>,...]] [--constant=<name>]\n"
+                 "          <digits> <option> <threads>\n",prog_name);
+  fprintf(stderr,"      <digits> digits of pi (or the --constant) to output\n");
+  fprintf(stderr,"      <option> 0 - just run (default)\n");
+  fprintf(stderr,"               1 - output decimal digits to stdout\n");
+  fprintf(stderr,"               4 - remove common factors of p and g (pi only)\n");
+  fprintf(stderr,"      <threads> number of threads (default 1)\n");
+  fprintf(stderr,"      --engine=<name> parallel engine, one of:");
+  for (i=0; engines[i]; i++)
+    fprintf(stderr," %s%s",engines[i]->name,i ? "" : " (default)");
+  fprintf(stderr,"\n");
+  fprintf(stderr,"      --constant=<name> the series to sum, one of:");
+  for (i=0; series_list[i]; i++)
+    fprintf(stderr," %s%s",series_list[i]->name,i ? "" : " (default)");
+  fprintf(stderr,"\n");
+  fprintf(stderr,"      --output=<file> write the digits to <file> instead of stdout\n");
+  fprintf(stderr,"      --format=<fmt> text (default) or packed, 19 digits per 64-bit word\n");
+  fprintf(stderr,"      --lowmem free merge operands as soon as they are used\n");
+  fprintf(stderr,"      --alloc=<name> GMP memory: malloc (default) or pool, per-thread pools\n");
+  fprintf(stderr,"      --memory=<MB> keep at most this much of the results waiting for\n"
+                 "                    a merge in memory, spill the rest to disk\n");
+  fprintf(stderr,"      --spill-dir=<dir> where spilled results go (default .)\n");
+  fprintf(stderr,"      --compress keep the results waiting for a merge packed in memory,\n"
+                 "                    p and g as their factors with option 4\n");
+  fprintf(stderr,"      --checkpoint=<dir> save finished chunks in <dir> and restart from\n"
+                 "                    them (forloop and cilk engines), removed when done\n");
+  fprintf(stderr,"      --extend=<file> reuse the root of a run for fewer digits saved in\n"
+                 "                    <file>, compute only the terms past it, save the new one\n");
+  fprintf(stderr,"      --cache=<dir> answer from the digits kept in <dir> when it has\n"
+                 "                    enough, else extend its root and keep the new digits\n");
+  fprintf(stderr,"      --batch=<file> run the jobs of <file>, '<digits> [<constant>]' a line\n"
+                 "                    (- for stdin), in place of <digits>, one after the\n"
+                 "                    other on one engine\n");
+  fprintf(stderr,"      --chunks=<n> chunks per thread, handed out dynamically (forloop\n"
+                 "                    and cilk engines, default 1)\n");
+  fprintf(stderr,"      --numa give each half of the top of the tree its own NUMA nodes,\n"
+                 "                    with node-local pool memory (nested engine)\n");
+  fprintf(stderr,"      --pipeline compute 1/sqrt(C) and the output's powers of ten on\n"
+                 "                    a thread of their own during the splitting\n");
+  fprintf(stderr,"      --calibrate time a few split ratios and cutoffs on this host and\n"
+                 "                    save the best, done by itself on a host's first run\n");
+  fprintf(stderr,"      --split=<ratio> where a node splits (default 0.5224 or the saved one)\n");
+  fprintf(stderr,"      --cutoff=<terms> nodes below this are not split across threads\n"
+                 "                    (nested engine, default 1000 or the saved one)\n");
+  fprintf(stderr,"      --tune-file=<file> where calibrations are kept\n"
+                 "                    (default $HOME/.raspberry-pi2)\n");
+  fprintf(stderr,"      --trace=<file> write a Chrome trace of the leaves, merge products\n"
+                 "                    and idle time, with sums per tree level and worker\n");
+  fprintf(stderr,"      --perf count cycles, instructions and LLC misses of every phase\n"
+                 "                    and tree level with perf_event_open\n");
+  fprintf(stderr,"      --verify[=<hex>,...] check 16 hex digits after these positions (default\n"
+                 "                    the last) with the BBP formula, and the hash of the\n"
+                 "                    digits written against known values\n");
+  exit(1);
+}
+
+/* what one job of --batch prints, and how its digits go out */
+typedef struct {
+  const batch_job_t *jobs;
+  long out,threads;
+  double cpu,wall;
+} batch_out_t;
+
+static int
+batch_done(int i,mpz_t x,long shift,long reused,void *arg)
+{
+  batch_out_t *b = arg;
+  long d = b->jobs[i].digits;
+  double cpu,wall;
+  digits_t digits;
+  char name[32];
+
+  if (b->out&1) {
+    digits_open(&digits,NULL,OUT_TEXT);
+    digits_write(&digits,x,shift,d,b->threads);
+    digits_close(&digits);
+    fflush(stdout);
+  }
+  cpu = cpu_time();
+  wall = wall_clock();
+  snprintf(name,sizeof(name),"job %d",i+1);
+  fprintf(stderr,"%-11scputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    name,cpu-b->cpu,wall-b->wall,cpu_factor(cpu-b->cpu,wall-b->wall));
+  fprintf(stderr,"   %ld digits of %s, terms=%ld, %ld reused\n",
+    d,series->name,terms,reused);
+  trace_phase(name,b->wall,wall);
+  fflush(stderr);
+  b->cpu = cpu;
+  b->wall = wall;
+  return 0;
+}
+
+/* every job of the batch file, one after the other on the same engine */
+static int
+run_batch(const char *path,long out,long threads,long cores,const char *trace)
+{
+  batch_job_t *jobs;
+  batch_out_t b;
+  uint64_t pv[PERF_EVENTS];
+  double begin,wbegin;
+  int n = batch_read(path,series,&jobs);
+
+  if (n < 0)
+    return 1;
+  if (n==0) {
+    fprintf(stderr,"%s: no jobs in '%s'\n",prog_name,path);
+    return 1;
+  }
+  fprintf(stderr,"# jobs=%d from %s, threads=%ld cores=%ld engine=%s\n",
+    n,path,threads,cores,engine->name);
+  fprintf(stderr,"# split=%.4f cutoff=%ld\n",split_ratio,split_cutoff);
+
+  b.jobs = jobs;
+  b.out = out;
+  b.threads = threads;
+  b.cpu = begin = cpu_time();
+  b.wall = wbegin = wall_clock();
+  perf_total(pv);
+  batch_run(jobs,n,threads,batch_done,&b);
+  fprintf(stderr,"total      cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    b.cpu-begin,b.wall-wbegin,cpu_factor(b.cpu-begin,b.wall-wbegin));
+  perf_phase("total",pv);
+  perf_report();
+  if (trace) {
+    long e = trace_close();
+
+    if (e < 0)
+      fprintf(stderr,"%s: cannot write trace '%s'\n",prog_name,trace);
+    else
+      fprintf(stderr,"   trace=%ld events in %s\n",e,trace);
+  }
+  fflush(stderr);
+  free(jobs);
+  return 0;
+}
+
+int
+main(int argc,char *argv[])
+{
+  mpz_t  x,t;
+  bs_t   root;
+  long d=100,out=0,threads=1,depth,psize,qsize,cores,prec,shift;
+  digits_t digits;
+  struct rusage rusage;
+  const char *output = NULL,*trace = NULL,*extend = NULL,*cache = NULL;
+  const char *batch = NULL;
+  int i,npos=0,format=OUT_TEXT,pool=0,calibrate=0,tuned,lead=1,numa=0,pipeline=0,perf=0;
+  double split = 0;
+  long cutoff = 0,reused = 0;
+  char *home_tune = NULL,*cache_ext = NULL;
+  double begin,mid0,mid1,end;
+  double wbegin,wmid0,wmid1,wend;
+  uint64_t pv0[PERF_EVENTS],pv[PERF_EVENTS];
+
+  prog_name = argv[0];
+  engine = engines[0];
+
+  for (i=1; i<argc; i++) {
+    if (strncmp(argv[i],"--engine=",9)==0) {
+      engine = find_engine(argv[i]+9);
+      if (!engine) {
+        fprintf(stderr,"%s: unknown engine '%s'\n",prog_name,argv[i]+9);
+        usage();
+      }
+    } else if (strncmp(argv[i],"--output=",9)==0) {
+      output = argv[i]+9;
+    } else if (strncmp(argv[i],"--format=",9)==0) {
+      if (strcmp(argv[i]+9,"text")==0)
+        format = OUT_TEXT;
+      else if (strcmp(argv[i]+9,"packed")==0)
+        format = OUT_PACKED;
+      else {
+        fprintf(stderr,"%s: unknown format '%s'\n",prog_name,argv[i]+9);
+        usage();
+      }
+    } else if (strncmp(argv[i],"--alloc=",8)==0) {
+      if (strcmp(argv[i]+8,"pool")==0)
+        pool = 1;
+      else if (strcmp(argv[i]+8,"malloc")==0)
+        pool = 0;
+      else {
+        fprintf(stderr,"%s: unknown allocator '%s'\n",prog_name,argv[i]+8);
+        usage();
+      }
+    } else if (strncmp(argv[i],"--memory=",9)==0) {
+      spill_budget = atol(argv[i]+9)<<20;
+    } else if (strncmp(argv[i],"--spill-dir=",12)==0) {
+      spill_dir = argv[i]+12;
+    } else if (strcmp(argv[i],"--compress")==0) {
+      spill_compress = 1;
+    } else if (strncmp(argv[i],"--checkpoint=",13)==0) {
+      ckpt_dir = argv[i]+13;
+    } else if (strncmp(argv[i],"--extend=",9)==0) {
+      extend = argv[i]+9;
+    } else if (strncmp(argv[i],"--batch=",8)==0) {
+      batch = argv[i]+8;
+    } else if (strncmp(argv[i],"--cache=",8)==0) {
+      cache = argv[i]+8;
+    } else if (strncmp(argv[i],"--chunks=",9)==0) {
+      chunks_per_thread = atol(argv[i]+9);
+      if (chunks_per_thread < 1) {
+        fprintf(stderr,"%s: --chunks needs at least 1\n",prog_name);
+        usage();
+      }
+    } else if (strncmp(argv[i],"--constant=",11)==0) {
+      series = find_series(argv[i]+11);
+      if (!series) {
+        fprintf(stderr,"%s: unknown constant '%s'\n",prog_name,argv[i]+11);
+        usage();
+      }
+    } else if (strcmp(argv[i],"--verify")==0) {
+      verify_on = 1;
+    } else if (strncmp(argv[i],"--verify=",9)==0) {
+      if (!verify_parse(argv[i]+9)) {
+        fprintf(stderr,"%s: --verify needs hex positions like 1000,2000\n",prog_name);
+        usage();
+      }
+    } else if (strncmp(argv[i],"--trace=",8)==0) {
+      trace = argv[i]+8;
+    } else if (strcmp(argv[i],"--perf")==0) {
+      perf = 1;
+    } else if (strcmp(argv[i],"--pipeline")==0) {
+      pipeline = 1;
+    } else if (strcmp(argv[i],"--numa")==0) {
+      numa = 1;
+    } else if (strcmp(argv[i],"--calibrate")==0) {
+      calibrate = 1;
+    } else if (strncmp(argv[i],"--split=",8)==0) {
+      split = atof(argv[i]+8);
+      if (split <= 0 || split >= 1) {
+        fprintf(stderr,"%s: --split needs a ratio between 0 and 1\n",prog_name);
+        usage();
+      }
+    } else if (strncmp(argv[i],"--cutoff=",9)==0) {
+      cutoff = atol(argv[i]+9);
+      if (cutoff < 1) {
+        fprintf(stderr,"%s: --cutoff needs at least 1\n",prog_name);
+        usage();
+      }
+    } else if (strncmp(argv[i],"--tune-file=",12)==0) {
+      tune_file = argv[i]+12;
+    } else if (strcmp(argv[i],"--lowmem")==0) {
+      lowmem = 1;
+    } else if (argv[i][0]=='-' && argv[i][1]=='-') {
+      fprintf(stderr,"%s: unknown option '%s'\n",prog_name,argv[i]);
+      usage();
+    } else {
+      /* a batch file stands in for <digits> */
+      if (npos==0 && !batch)
+        d = strtoul(argv[i],0,0);
+      else if (npos==1-(batch!=NULL))
+        out = atoi(argv[i]);
+      else if (npos==2-(batch!=NULL))
+        threads = atoi(argv[i]);
+      npos++;
+    }
+  }
+  if (npos==0 && !batch)
+    usage();
+  if (batch && (output || cache || extend || ckpt_dir || (out&4) || verify_on ||
+                pipeline || strcmp(engine->name,"mpi")==0)) {
+    fprintf(stderr,"%s: --batch takes none of --output, --cache, --extend, --checkpoint,\n"
+                   "    option 4, --verify, --pipeline or the mpi engine\n",prog_name);
+    usage();
+  }
+  if (format==OUT_PACKED && !output && !cache) {
+    fprintf(stderr,"%s: the packed format needs --output or --cache\n",prog_name);
+    usage();
+  }
+  if (series!=&series_pi && ((out&4) || verify_on)) {
+    fprintf(stderr,"%s: option 4 and --verify are for pi only\n",prog_name);
+    usage();
+  }
+  if (numa && strcmp(engine->name,"nested")!=0) {
+    fprintf(stderr,"%s: --numa is for the nested engine\n",prog_name);
+    usage();
+  }
+  if (ckpt_dir && strcmp(engine->name,"forloop")!=0 && strcmp(engine->name,"cilk")!=0) {
+    fprintf(stderr,"%s: --checkpoint is for the forloop and cilk engines\n",prog_name);
+    usage();
+  }
+  if (pipeline && strcmp(engine->name,"mpi")==0) {
+    fprintf(stderr,"%s: --pipeline is not for the mpi engine\n",prog_name);
+    usage();
+  }
+  if (output || (out&1))
+    digits_open(&digits,output,format);
+  if (numa) {
+    numa_start();
+    pool = 1;
+  }
+  if (pool)
+    alloc_start();
+  factor = (out&4) != 0;
+
+  if (threads < 1) {
+    fprintf(stderr,"Number of threads reset from %ld to 1\n",threads);
+    fflush(stderr);
+    threads = 1;
+  }
+
+  cores = get_nprocs();
+  if (engine->init)
+    engine->init(threads);
+#ifdef HAVE_MPI
+  /* under mpirun only rank 0 tunes and prints the header */
+  if (engine==&engine_mpi)
+    lead = mpi_rank()==0;
+#endif
+
+  /* split ratio and cutoff: saved, calibrated on the first run if they
+     can be saved, overridden */
+  if (!tune_file && getenv("HOME")) {
+    home_tune = malloc(strlen(getenv("HOME"))+32);
+    sprintf(home_tune,"%s/.raspberry-pi2",getenv("HOME"));
+    tune_file = home_tune;
+  }
+  if (lead) {
+    tuned = tune_load();
+    if ((tune_file && !(split && cutoff) && (tuned==0 || (tuned==1 && threads > 1)) &&
+         root_writable(tune_file)) || calibrate)
+      tune_calibrate(threads);
+  }
+#ifdef HAVE_MPI
+  if (engine==&engine_mpi)
+    mpi_share_tune();
+#endif
+  if (split)
+    split_ratio = split;
+  if (cutoff)
+    split_cutoff = cutoff;
+
+  /* after the calibration, which is not the run's work */
+  if (trace)
+    trace_open(trace);
+  if (perf && !perf_start())
+    fprintf(stderr,"%s: --perf: perf_event_open is not allowed here\n",prog_name);
+
+  if (batch)
+    exit(run_batch(batch,out,threads,cores,trace));
+
+  terms = series->terms(d);
+  depth = 0;
+  while ((1L<<depth)<terms)
+    depth++;
+  depth++;
+
+  if (lead) {
+    fprintf(stderr,"# terms=%ld, depth=%ld, threads=%ld cores=%ld engine=%s%s%s\n",
+      terms,depth,threads,cores,engine->name,
+      series!=&series_pi ? " constant=" : "",series!=&series_pi ? series->name : "");
+    fprintf(stderr,"# split=%.4f cutoff=%ld%s",split_ratio,split_cutoff,numa ? "" : "\n");
+    if (numa)
+      fprintf(stderr," numa=%d nodes\n",numa_nodes);
+    if (perf_on) {
+      char names[128];
+
+      perf_names(names,sizeof(names));
+      fprintf(stderr,"# perf=%s\n",names);
+    }
+  }
+
+  mid0 = begin = cpu_time();
+  wmid0 = wbegin = wall_clock();
+  perf_total(pv0);
+  memcpy(pv,pv0,sizeof(pv));
+
+  /* a cache with enough digits answers at once, else the run extends its root */
+  if (cache && (output || (out&1)) && cache_serve(cache,d < 1 ? 1 : d,&digits)) {
+    end = cpu_time();
+    wend = wall_clock();
+    fprintf(stderr,"cache      cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+      end-begin,wend-wbegin,cpu_factor(end-begin,wend-wbegin));
+    fprintf(stderr,"total      cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+      end-begin,wend-wbegin,cpu_factor(end-begin,wend-wbegin));
+    fprintf(stderr,"   cache hit in %s\n",cache);
+    trace_phase("cache",wbegin,wend);
+    perf_phase("cache",pv0);
+    perf_report();
+    if (trace)
+      trace_close();
+    fflush(stderr);
+    digits_close(&digits);
+    exit(0);
+  }
+  if (cache && !extend)
+    extend = cache_ext = cache_root(cache);
+  /* a bad root is found before the sieve and the splitting are paid for */
+  if (extend && root_terms(extend) < 0) {
+    fprintf(stderr,"%s: '%s' is not a saved root of %s%s\n",prog_name,extend,
+      series->name,factor ? " with option 4" : "");
+    exit(1);
+  }
+  if (extend && !root_writable(extend)) {
+    fprintf(stderr,"%s: cannot write the root '%s'\n",prog_name,extend);
+    exit(1);
+  }
+
+  /* fixed point precision, in bits */
+
+  prec = (long)(d*BITS_PER_DIGIT+16);
+
+  /* what needs only d runs next to the sieve and the splitting */
+  if (pipeline)
+    final_start(prec+NEWTON_GUARD,
+                cache ? OUT_PACKED : output || (out&1) ? format : -1,
+                cache || output,d < 1 ? 1 : d,threads);
+
+  if (factor) {
+    build_sieve(6*terms > 3*5*23*29 ? 6*terms : 3*5*23*29+1,threads);
+    mid1 = cpu_time();
+    wmid1 = wall_clock();
+    /* every rank needs the sieve, rank 0 reports it */
+    if (lead) {
+      fprintf(stderr,"sieve      cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+        mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+      trace_phase("sieve",wmid0,wmid1);
+      perf_phase("sieve",pv);
+      fflush(stderr);
+    }
+    mid0 = mid1;
+    wmid0 = wmid1;
+    perf_total(pv);
+  }
+
+  bs_init(root);
+
+  /* begin binary splitting process */
+
+  if (extend) {
+    if ((reused = bs_extend(root,extend,threads)) < 0)
+      exit(1);
+  } else
+    bs_root(root,threads);
+
+  mid1 = cpu_time();
+  wmid1 = wall_clock();
+  fprintf(stderr,"bs         cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+  trace_phase("bs",wmid0,wmid1);
+  perf_phase("bs",pv);
+  if (extend)
+    fprintf(stderr,"   root=%ld terms from %s, %ld new\n",reused,extend,terms-reused);
+  fflush(stderr);
+
+  mpz_clear(root->g);
+  fac_clear(root->fp);
+  fac_clear(root->fg);
+  free_sieve();
+
+  psize = mpz_sizeinbase(root->p,10);
+  qsize = mpz_sizeinbase(root->q,10);
+
+  mid0 = cpu_time();
+  wmid0 = wall_clock();
+  perf_total(pv);
+
+  mpz_init(x);
+  mpz_init(t);
+  shift = final_div(root,x,t,prec+NEWTON_GUARD,threads);
+
+  mid1 = cpu_time();
+  wmid1 = wall_clock();
+  fprintf(stderr,"%-11scputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    series!=&series_pi ? "div" : "div/sqrt",mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+  trace_phase(series!=&series_pi ? "div" : "div/sqrt",wmid0,wmid1);
+  perf_phase(series!=&series_pi ? "div" : "div/sqrt",pv);
+  fflush(stderr);
+
+  mid0 = cpu_time();
+  wmid0 = wall_clock();
+  perf_total(pv);
+
+  shift = final_mul(root,x,t,shift,prec+NEWTON_GUARD,threads);
+
+  mid1 = end = cpu_time();
+  wmid1 = wend = wall_clock();
+  fprintf(stderr,"mul        cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+  trace_phase("mul",wmid0,wmid1);
+  perf_phase("mul",pv);
+  fflush(stderr);
+
+  if (verify_on) {
+    mid0 = cpu_time();
+    wmid0 = wall_clock();
+    perf_total(pv);
+
+    /* the 3 is one of the d digits */
+    verify_hex(x,shift,(long)((d-1)*BITS_PER_DIGIT),threads);
+
+    mid1 = end = cpu_time();
+    wmid1 = wend = wall_clock();
+    fprintf(stderr,"verify     cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+      mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+    trace_phase("verify",wmid0,wmid1);
+    perf_phase("verify",pv);
+    fflush(stderr);
+  }
+
+  /* pi = x/2^shift, scale and convert its first d digits */
+
+  final_wait();
+  if (output || (out&1)) {
+    mid0 = cpu_time();
+    wmid0 = wall_clock();
+    perf_total(pv);
+
+    if (cache)
+      cache_store(cache,x,shift,d < 1 ? 1 : d,&digits,threads);
+    else
+      digits_write(&digits,x,shift,d < 1 ? 1 : d,threads);
+
+    mid1 = end = cpu_time();
+    wmid1 = wend = wall_clock();
+    fprintf(stderr,"out        cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+      mid1-mid0,wmid1-wmid0,cpu_factor(mid1-mid0,wmid1-wmid0));
+    trace_phase("out",wmid0,wmid1);
+    perf_phase("out",pv);
+    fflush(stderr);
+  }
+  else if (cache)
+    cache_store(cache,x,shift,d < 1 ? 1 : d,NULL,threads);
+  ckpt_clear();
+  mpz_clear(x);
+  mpz_clear(t);
+
+  /* output Pi and timing statistics */
+
+  fprintf(stderr,"total      cputime = %8.2f  wallclock = %8.2f   factor = %8.2f\n",
+    end-begin,wend-wbegin,cpu_factor(end-begin,wend-wbegin));
+  perf_phase("total",pv0);
+  fflush(stderr);
+
+  fprintf(stderr,"   P size=%ld digits (%f)\n"
+	 "   Q size=%ld digits (%f)\n",
+	 psize,(double)psize/d,qsize,(double)qsize/d);
+  (void) getrusage(RUSAGE_SELF,&rusage);
+  fprintf(stderr,"   peak RSS=%ld kB (%f bytes per digit)\n",
+	 rusage.ru_maxrss,rusage.ru_maxrss*1024.0/d);
+  if (spill_budget >= 0)
+    fprintf(stderr,"   spilled=%ld MB in %ld files\n",
+	   spill_bytes()>>20,spill_files());
+  if (spill_compress) {
+    long before,after = spill_packed(&before);
+
+    fprintf(stderr,"   compressed=%ld kB of %ld kB waiting (%f)\n",
+	   after>>10,before>>10,before ? (double)after/before : 1.0);
+  }
+  if (pool)
+    fprintf(stderr,"   pool in use=%ld kB, high water=%ld kB\n",
+	   alloc_in_use()/1024,alloc_high_water()/1024);
+  perf_report();
+  fflush(stderr);
+
+  if (trace) {
+    long n = trace_close();
+
+    if (n < 0)
+      fprintf(stderr,"%s: cannot write trace '%s'\n",prog_name,trace);
+    else
+      fprintf(stderr,"   trace=%ld events in %s\n",n,trace);
+  }
+  fflush(stderr);
+
+  if (output || (out&1))
+    digits_close(&digits);
+  free(home_tune);
+  free(cache_ext);
+
+  exit (0);
+}
@@ -0,0 +1,351 @@
+/* Pi computation using Chudnovsky's algortithm.
+
+ * Declarations shared by the driver in raspberry-pi2.c, the library in
+   raspberry-pi2-lib.c, the binary splitting helpers in raspberry-pi2-bs.c
+   and the parallel engines in raspberry-pi2-openmp*.c and
+   raspberry-pi2-cilk*.c.  The library's public interface is chudnovsky.h.
+
+ * Redistribution and use in source and binary forms,with or without
+ * modification,are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES,INCLUDING,BUT NOT LIMITED TO,THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO
+ * EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT,INDIRECT,INCIDENTAL,
+ * SPECIAL,EXEMPLARY,OR CONSEQUENTIAL DAMAGES (INCLUDING,BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,DATA,OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT,STRICT LIABILITY,OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef RASPBERRY_PI2_H
+#define RASPBERRY_PI2_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#define A   13591409
+#define B   545140134
+#define C   640320
+#define D   12
+
+#define BITS_PER_DIGIT   3.32192809488736234787
+#define DIGITS_PER_ITER  14.1816474627254776555
+#define DOUBLE_PREC      53
+
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+# define GCC_COMPILER 1
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+
+/* factored form of an odd integer: fac[i]^pow[i], fac[] ascending */
+typedef struct {
+  unsigned long max_facs;
+  unsigned long num_facs;
+  unsigned long *fac;
+  unsigned long *pow;
+} fac_struct;
+typedef fac_struct fac_t[1];
+
+/* p(a,b), q(a,b), g(a,b) of one node of the splitting tree */
+typedef struct {
+  mpz_t p,q,g;
+  fac_t fp,fg;
+  unsigned long a,b;            /* the terms it covers, for the trace */
+  long idle;                    /* bytes counted against --memory */
+  struct spill *spill;          /* where it is on disk, or NULL */
+  long zeros[3];                /* low zero bits --compress took off p, q, g */
+  int packed;                   /* which of p, g it left to fp, fg */
+} bs_struct;
+typedef bs_struct bs_t[1];
+
+/* a unit of work for the pool in raspberry-pi2-steal.c */
+typedef struct {
+  void (*fn)(void *);
+  void *arg;
+  int done;
+  int external;
+} task_t;
+
+/* a parallel scheduling strategy for the binary splitting tree */
+typedef struct {
+  const char *name;
+  /* set up the runtime for the given number of workers */
+  void (*init)(long threads);
+  /* r = (p,q,g) of [0,terms) */
+  void (*bs)(bs_t r,long threads);
+  /* run job(0..n-1,arg) concurrently and wait for all of them */
+  void (*run)(int n,void (*job)(int,void *),void *arg);
+} engine_t;
+
+/* raspberry-pi2-lib.c */
+extern long terms;
+extern int factor;
+extern int lowmem;
+extern long chunks_per_thread;
+extern int verbose;             /* the engines print their own phase lines */
+extern unsigned long bs_first;  /* the engines compute [bs_first,terms) */
+extern int keep_g;              /* and keep g of the root too, for --extend */
+extern char *prog_name;
+extern const engine_t *engine;
+extern const engine_t *const engines[];
+
+extern const engine_t engine_nested;
+extern const engine_t engine_task;
+extern const engine_t engine_forloop;
+extern const engine_t engine_steal;
+#ifdef HAVE_CILK
+extern const engine_t engine_cilk;
+extern const engine_t engine_cilk_task;
+#endif
+#ifdef HAVE_MPI
+extern const engine_t engine_mpi;
+int  mpi_rank(void);
+void mpi_share_tune(void);
+#endif
+
+double wall_clock(void);
+double cpu_time(void);
+double cpu_factor(double cpu,double wall);
+
+const engine_t *find_engine(const char *name);
+void bs_root(bs_t r,long threads);
+long bs_extend(bs_t r,const char *path,long threads);
+void final_start(long m,int format,int file,long d,long threads);
+void final_wait(void);
+long final_div(bs_t root,mpz_t x,mpz_t t,long m,long threads);
+long final_mul(bs_t root,mpz_t x,mpz_t t,long shift,long m,long threads);
+
+/* raspberry-pi2-bs.c */
+void build_sieve(unsigned long n,long threads);
+void free_sieve(void);
+
+void fac_init(fac_t f);
+void fac_clear(fac_t f);
+void fac_mul(fac_t f,fac_t g);
+void fac_remove_gcd(mpz_t p,fac_t fp,mpz_t g,fac_t fg);
+void fac_value(mpz_t r,fac_t f);
+
+void bs_init(bs_t r);
+void bs_clear(bs_t r);
+void bs_swap(bs_t r,bs_t s);
+void bs_leaf(unsigned long b,bs_t r);
+void bs_block(unsigned long a,unsigned long b,bs_t r);
+void bs_merge(bs_t r1,bs_t r2,int gflag,int tds);
+void bs_partition(unsigned long *edge,long n);
+unsigned long bs_split(unsigned long a,unsigned long b);
+long bs_depth(unsigned long n);
+
+void run_serial(int n,void (*job)(int,void *),void *arg);
+
+/* the gflag of a merge ending at b: g is only dropped at the root */
+#define BS_GFLAG(b)  ((b) < (unsigned long)terms || keep_g)
+
+/* the workers of a node at level, threads/2^(level-1) but at least one;
+   a skewed split can make the tree deeper than the shift allows */
+#define BS_TDS(threads,level) \
+  ((level)-1 < 63 && ((threads)>>((level)-1)) > 0 ? (int)((threads)>>((level)-1)) : 1)
+
+#ifndef LEAF_TERMS
+#define LEAF_TERMS  16          /* terms of one block of bs_block */
+#endif
+
+/* the limb helpers of bs_block(), for the series kernels */
+mp_size_t mul_limbs(mp_ptr rp,mp_size_t n,const mp_limb_t *v,int k);
+void add_signed(mp_ptr q,mp_size_t *qn,int *qs,mp_srcptr t,mp_size_t tn,int ts);
+void set_limbs(mpz_t z,mp_srcptr l,mp_size_t n,int sign);
+
+/* raspberry-pi2-series.c */
+
+/* value = (a0 + sum_{k>=1} a(k) prod_{i<=k} p(i)/q(i)) * num/den */
+typedef struct {
+  const char *name;
+  int id;                       /* kept in checkpoints */
+  /* terms a+1..b into r, as bs_block(); NULL for pi */
+  void (*block)(unsigned long a,unsigned long b,bs_t r);
+  unsigned long a0,num,den;
+  int e10;                      /* value = 0.ddd * 10^e10 */
+  /* terms for d digits */
+  unsigned long (*terms)(long d);
+  /* p, q and g grow by about bits_log*log2(k)+bits_one bits at term k,
+     the mean of the three, for the engines' cost estimates */
+  double bits_log,bits_one;
+} series_t;
+
+extern const series_t *series;
+extern const series_t series_pi;
+extern const series_t *const series_list[];
+
+const series_t *find_series(const char *name);
+
+/* raspberry-pi2-mul.c */
+#ifndef PMUL_LIMBS
+#define PMUL_LIMBS  (1L<<16)    /* operands below this use plain mpz_mul */
+#endif
+
+extern long pmul_limbs;
+void pmul(mpz_ptr r,mpz_srcptr a,mpz_srcptr b,int tds);
+
+/* raspberry-pi2-newton.c */
+#define NEWTON_GUARD  64        /* bits kept beyond the wanted precision */
+
+void newton_inv(mpz_t x,mpz_srcptr q,long m,int tds);
+void newton_invsqrt(mpz_t t,unsigned long c,long m,int tds);
+
+/* raspberry-pi2-out.c */
+#define RADIX_DIGITS  1024      /* smallest piece for one mpz_get_str */
+
+#define OUT_TEXT      0         /* the text that goes to stdout */
+#define OUT_PACKED    1         /* 19 digits per little endian uint64 */
+#define PACK_DIGITS   19        /* decimal digits in one packed word */
+#define PACK_HEADER   128       /* bytes of text in front of the words */
+
+/* where the output digits go */
+typedef struct {
+  char  *buf;
+  size_t len,size;
+  const char *path;
+  int    fd,format;
+} digits_t;
+
+void radix_pow10(mpz_t r,unsigned long e,int tds);
+void radix_prepare(size_t len,int format,size_t blk,long threads);
+void radix_convert(char *buf,mpz_t n,size_t len,int format,size_t blk,
+                   void (*done_fn)(char *,size_t),long threads);
+
+void digits_open(digits_t *o,const char *path,int format);
+void digits_map(digits_t *o,size_t size);
+void digits_prepare(int format,int file,long d,long threads);
+void digits_write(digits_t *o,mpz_t x,long shift,long d,long threads);
+void digits_close(digits_t *o);
+int  digits_stream(mpz_t x,long shift,long d,size_t blk,
+                   int (*fn)(const char *,size_t,void *),void *arg,long threads);
+
+/* raspberry-pi2-verify.c */
+#define VERIFY_MAX      16      /* hex positions of one --verify list */
+#define VERIFY_THREADS  64      /* most threads on one position */
+
+extern int verify_on;
+
+int verify_parse(const char *list);
+void verify_hex(mpz_srcptr x,long shift,long bits,long threads);
+void verify_digits(const char *buf,size_t n,int format);
+
+/* raspberry-pi2-spill.c */
+extern long spill_budget;
+extern const char *spill_dir;
+extern int spill_compress;
+
+void bs_spill(bs_t r);
+void spill_get(bs_t r,mpz_srcptr *p,mpz_srcptr *q);
+void spill_put(bs_t r);
+void spill_back(bs_t r);
+long spill_bytes(void);
+long spill_files(void);
+long spill_packed(long *before);
+
+/* raspberry-pi2-ckpt.c */
+extern const char *ckpt_dir;
+
+void ckpt_save(unsigned long a,unsigned long b,bs_t r);
+int  ckpt_load(unsigned long a,unsigned long b,bs_t r);
+void ckpt_drop(unsigned long a,unsigned long b);
+void ckpt_clear(void);
+int  root_save(const char *path,bs_t r);
+int  root_writable(const char *path);
+char *temp_file(const char *path);
+long root_terms(const char *path);
+int  root_load(const char *path,bs_t r);
+
+/* raspberry-pi2-chunks.c */
+void chunks_bs(bs_t r,long threads,long workers,
+               void (*loop)(long n,long threads,void (*body)(long i,long w)));
+
+/* raspberry-pi2-cache.c */
+char *cache_root(const char *dir);
+int  cache_serve(const char *dir,long d,digits_t *o);
+void cache_store(const char *dir,mpz_t x,long shift,long d,digits_t *o,long threads);
+
+/* raspberry-pi2-batch.c */
+typedef struct {
+  const series_t *series;
+  long digits;
+} batch_job_t;
+
+int batch_run(const batch_job_t *jobs,int n,long threads,
+              int (*done)(int i,mpz_t x,long shift,long reused,void *arg),void *arg);
+int batch_read(const char *path,const series_t *def,batch_job_t **jobs);
+
+/* raspberry-pi2-tune.c */
+extern double split_ratio;
+extern long split_cutoff;
+extern const char *tune_file;
+
+int  tune_load(void);
+int  tune_save(void);
+void tune_calibrate(long threads);
+
+/* raspberry-pi2-trace.c */
+enum {
+  TRACE_LEAF,TRACE_P1P2,TRACE_Q1P2,TRACE_Q2G1,TRACE_G1G2,TRACE_IDLE,
+  TRACE_PHASE,TRACE_KINDS
+};
+
+#define TRACE_LEVELS  64
+
+extern int trace_on;
+
+void   trace_open(const char *path);
+int    trace_level(unsigned long a,unsigned long b);
+double trace_now(void);
+void   trace_event(int kind,double t0,unsigned long a,unsigned long b,
+                   long bits0,long bits1);
+void   trace_phase(const char *name,double t0,double t1);
+long   trace_close(void);
+
+/* raspberry-pi2-perf.c */
+#define PERF_EVENTS   4         /* task clock, cycles, instructions, LLC misses */
+
+extern int perf_on;
+
+int  perf_start(void);
+void perf_names(char *buf,size_t n);
+void perf_total(uint64_t *v);
+void perf_phase(const char *name,const uint64_t *v0);
+void perf_thread(void);
+int  perf_level(void);
+int  perf_enter(int level);
+void perf_leave(int old);
+void perf_report(void);
+
+/* raspberry-pi2-alloc.c */
+void alloc_start(void);
+long alloc_in_use(void);
+long alloc_high_water(void);
+
+/* raspberry-pi2-numa.c */
+extern int numa_nodes;
+
+int  numa_start(void);
+void numa_bind(int n0,int n1);
+void numa_place(void *p,size_t len);
+
+/* raspberry-pi2-steal.c */
+void pool_start(int n);
+int  pool_workers(void);
+int  pool_idle(void);
+int  pool_want_task(void);
+void pool_spawn(task_t *t);
+void pool_sync(task_t *t);
+void pool_call(void (*fn)(void *),void *arg);
+
+#endif